@@ -0,0 +1,282 @@
+// musil_bench.cpp
+//
+// Microbenchmarks of the interpreter (reader, eval dispatch, closures,
+// environment lookup and forking) and of its primitives (array ops, linear
+// algebra, machine learning, SVG plotting). Each case is warmed up and then timed in
+// three rounds of at least min-time / 3 seconds; the fastest round is kept.
+// Heap traffic is measured by replacing the global operator new.
+//
+// usage: musil_bench [--filter regex] [--min-time secs] [--json file]
+//                    [--baseline file] [--threshold percent]
+//
+// With --baseline, cases slower than the baseline by more than threshold
+// percent (default 10) are reported and the exit status is 1. Baselines are
+// machine specific: regenerate them with --json on the machine that gates.
+
+#include "musil.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <regex>
+#include <map>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+#include <getopt.h>
+
+using namespace std;
+
+YieldFunction g_yield = nullptr;
+
+// counting allocator
+#if defined (__GNUC__) && !defined (__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // malloc/free behind replaced new/delete
+#endif
+static atomic<size_t> g_alloc_bytes {0}, g_alloc_count {0};
+void* operator new (size_t n) {
+	g_alloc_bytes.fetch_add (n, memory_order_relaxed);
+	g_alloc_count.fetch_add (1, memory_order_relaxed);
+	if (void* p = malloc (n ? n : 1)) return p;
+	throw bad_alloc ();
+}
+void operator delete (void* p) noexcept { free (p); }
+void operator delete (void* p, size_t) noexcept { free (p); }
+
+struct Case {
+	string name;
+	function<void ()> run; // one op
+};
+struct Result {
+	string name;
+	size_t iterations;
+	double ns_per_op, bytes_per_op, allocs_per_op;
+};
+
+// cases
+AtomPtr parse (const string& src) {
+	istringstream in (src);
+	unsigned linenum = 0;
+	return read (in, linenum);
+}
+Case eval_case (const string& name, AtomPtr env, const string& expr) {
+	AtomPtr e = parse (expr);
+	return Case {name, [e, env] () { eval (e, env); }};
+}
+AtomPtr random_matrix (size_t rows, size_t cols, Real diag = 0) {
+	AtomPtr m = make_atom ();
+	for (size_t i = 0; i < rows; ++i) {
+		valarray<Real> r (cols);
+		for (size_t j = 0; j < cols; ++j) r[j] = (Real) rand () / RAND_MAX + (i == j ? diag : 0);
+		m->tail.push_back (make_atom (move (r)));
+	}
+	return m;
+}
+void define (const string& name, AtomPtr v, AtomPtr env) {
+	extend (make_atom (name), v, env);
+}
+vector<Case> make_cases (AtomPtr env) {
+	srand (1);
+	vector<Case> cases;
+
+	// reader
+	stringstream src;
+	for (int i = 0; i < 100; ++i) {
+		src << "(def f" << i << " (lambda (x y) { (+ x [1 2.5 3e-2]) (lindex '(a b \"str\") 1) }))\n";
+	}
+	string text = src.str ();
+	cases.push_back (Case {"read", [text] () {
+		istringstream in (text);
+		unsigned linenum = 0;
+		while (read (in, linenum)) {}
+	}});
+
+	// evaluation
+	cases.push_back (eval_case ("eval-dispatch", env, "(+ 1 2)"));
+	eval (parse ("(def bench-id (lambda (x) x))"), env);
+	cases.push_back (eval_case ("closure-call", env, "(bench-id 1)"));
+	eval (parse ("(def bench-fib (lambda (n) (if (< n 2) n (+ (bench-fib (- n 1)) (bench-fib (- n 2))))))"), env);
+	cases.push_back (eval_case ("fib-15", env, "(bench-fib 15)"));
+	AtomPtr frame = env;
+	for (int i = 0; i < 8; ++i) { // nested frames with a few bindings each
+		AtomPtr child = make_atom ();
+		child->tail.push_back (frame);
+		for (int j = 0; j < 4; ++j) define ("v" + to_string (i) + "_" + to_string (j), make_atom ((Real) j), child);
+		frame = child;
+	}
+	AtomPtr sym = make_atom (string ("bench-id"));
+	cases.push_back (Case {"env-lookup-depth-8", [sym, frame] () { assoc (sym, frame); }});
+	AtomPtr base = make_env (); // forking freezes it
+	eval (parse ("(def bench-id (lambda (x) x))"), base);
+	AtomPtr job = parse ("{ (def bench-x 1) (bench-id bench-x) }");
+	cases.push_back (Case {"fork-env", [job, base] () { eval (job, fork_env (base)); }});
+
+	// arrays
+	define ("bench-a", make_atom (valarray<Real> (1.5, 65536)), env);
+	define ("bench-b", make_atom (valarray<Real> (2.5, 65536)), env);
+	cases.push_back (eval_case ("array-add-64k", env, "(+ bench-a bench-b)"));
+	cases.push_back (eval_case ("array-sin-64k", env, "(sin bench-a)"));
+	cases.push_back (eval_case ("array-mul-scalar-64k", env, "(* bench-a 0.5)"));
+
+	// linear algebra and machine learning
+	define ("bench-m", random_matrix (64, 64), env);
+	define ("bench-s", random_matrix (64, 64, 64), env); // diagonally dominant
+	define ("bench-v", make_atom (valarray<Real> (1., 64)), env);
+	define ("bench-data", random_matrix (500, 8), env);
+	cases.push_back (eval_case ("matmul-64", env, "(matmul bench-m bench-m)"));
+	cases.push_back (eval_case ("solve-64", env, "(solve bench-s bench-v)"));
+	cases.push_back (eval_case ("pca-500x8", env, "(pca bench-data)"));
+	cases.push_back (eval_case ("kmeans-500x8-k4", env, "(kmeans bench-data 4)"));
+	AtomPtr train = make_atom ();
+	AtomPtr points = random_matrix (500, 8);
+	for (size_t i = 0; i < points->tail.size (); ++i) {
+		AtomPtr item = make_atom ();
+		item->tail.push_back (points->tail.at (i));
+		item->tail.push_back (make_atom (string (i % 2 ? "\"a" : "\"b")));
+		train->tail.push_back (item);
+	}
+	define ("bench-train", train, env);
+	define ("bench-query", random_matrix (50, 8), env);
+	cases.push_back (eval_case ("knn-500x8-q50", env, "(knn bench-train 5 bench-query)"));
+
+	// plotting (writes and removes musil_bench.svg in the working directory)
+	define ("bench-y", random_matrix (1, 1024)->tail.at (0), env);
+	AtomPtr plot = parse ("(plot \"musil_bench\" bench-y \"-\")");
+	cases.push_back (Case {"plot-svg-1k", [plot, env] () {
+		eval (plot, env);
+		remove ("musil_bench.svg");
+	}});
+	return cases;
+}
+
+// measurement
+Result measure (const Case& c, double min_time) {
+	typedef chrono::steady_clock Clock;
+	size_t n = 1;
+	while (true) { // warmup, sizing batches to about 10 ms
+		Clock::time_point t0 = Clock::now ();
+		for (size_t i = 0; i < n; ++i) c.run ();
+		double t = chrono::duration<double> (Clock::now () - t0).count ();
+		if (t > 0.01) break;
+		n *= 2;
+	}
+	Result best {c.name, 0, 1e300, 0, 0};
+	for (int round = 0; round < 3; ++round) {
+		size_t iters = 0;
+		size_t bytes = g_alloc_bytes, count = g_alloc_count;
+		Clock::time_point t0 = Clock::now ();
+		double t = 0;
+		while (t < min_time / 3) {
+			for (size_t i = 0; i < n; ++i) c.run ();
+			iters += n;
+			t = chrono::duration<double> (Clock::now () - t0).count ();
+		}
+		double ns = t * 1e9 / iters;
+		if (ns < best.ns_per_op) {
+			best.iterations = iters;
+			best.ns_per_op = ns;
+			best.bytes_per_op = (double) (g_alloc_bytes - bytes) / iters;
+			best.allocs_per_op = (double) (g_alloc_count - count) / iters;
+		}
+	}
+	return best;
+}
+
+// results
+void write_json (const vector<Result>& results, ostream& out) {
+	out << "{\n  \"version\": \"" << VERSION << "\",\n  \"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size (); ++i) {
+		const Result& r = results[i];
+		out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+			<< ", \"ns_per_op\": " << r.ns_per_op << ", \"bytes_per_op\": " << r.bytes_per_op
+			<< ", \"allocs_per_op\": " << r.allocs_per_op << "}" << (i + 1 < results.size () ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+map<string, double> read_baseline (const string& fname) { // name -> ns_per_op, as written by write_json
+	ifstream in (fname);
+	if (!in.good ()) throw runtime_error ("cannot open baseline " + fname);
+	stringstream text;
+	text << in.rdbuf ();
+	string s = text.str ();
+	map<string, double> base;
+	regex entry ("\"name\":\\s*\"([^\"]+)\"[^}]*\"ns_per_op\":\\s*([-+0-9.eE]+)");
+	for (sregex_iterator it (s.begin (), s.end (), entry), end; it != end; ++it) {
+		base[(*it)[1]] = stod ((*it)[2]);
+	}
+	return base;
+}
+
+int main (int argc, char* argv[]) {
+	string filter = ".*", json_file, baseline_file;
+	double min_time = 1, threshold = 10;
+	static struct option long_options[] = {
+		{"filter", required_argument, nullptr, 'f'},
+		{"min-time", required_argument, nullptr, 'm'},
+		{"json", required_argument, nullptr, 'j'},
+		{"baseline", required_argument, nullptr, 'b'},
+		{"threshold", required_argument, nullptr, 't'},
+		{nullptr, 0, nullptr, 0}
+	};
+	int opt = 0;
+	while ((opt = getopt_long (argc, argv, "", long_options, nullptr)) != -1) {
+		switch (opt) {
+		case 'f': filter = optarg; break;
+		case 'm': min_time = atof (optarg); break;
+		case 'j': json_file = optarg; break;
+		case 'b': baseline_file = optarg; break;
+		case 't': threshold = atof (optarg); break;
+		default:
+			cerr << "usage is " << argv[0] << " [--filter regex] [--min-time secs] [--json file] "
+				<< "[--baseline file] [--threshold percent]" << endl;
+			return 2;
+		}
+	}
+	try {
+		map<string, double> base;
+		if (baseline_file.size ()) base = read_baseline (baseline_file);
+		AtomPtr env = make_env ();
+		regex selected (filter);
+		vector<Result> results;
+		int regressions = 0;
+		cout << left << setw (24) << "case" << right << setw (14) << "ns/op" << setw (14) << "bytes/op"
+			<< setw (12) << "allocs/op" << (base.size () ? "    vs baseline" : "") << endl;
+		for (const Case& c : make_cases (env)) {
+			if (!regex_search (c.name, selected)) continue;
+			Result r = measure (c, min_time);
+			results.push_back (r);
+			cout << left << setw (24) << r.name << right << fixed << setprecision (1)
+				<< setw (14) << r.ns_per_op << setw (14) << r.bytes_per_op << setw (12) << r.allocs_per_op;
+			auto b = base.find (r.name);
+			if (b != base.end ()) {
+				double change = 100. * (r.ns_per_op / b->second - 1);
+				cout << setw (14) << showpos << change << "%" << noshowpos;
+				if (change > threshold) {
+					cout << "  REGRESSION";
+					++regressions;
+				}
+			}
+			cout << defaultfloat << endl;
+		}
+		if (json_file.size ()) {
+			ofstream out (json_file);
+			if (!out.good ()) throw runtime_error ("cannot write " + json_file);
+			write_json (results, out);
+		}
+		if (regressions) {
+			cerr << regressions << " case(s) slower than the baseline by more than " << threshold << "%" << endl;
+			return 1;
+		}
+	} catch (AtomPtr& e) {
+		cerr << "error: "; print (e, cerr) << endl;
+		return 2;
+	} catch (exception& e) {
+		cerr << "error: " << e.what () << endl;
+		return 2;
+	}
+	return 0;
+}
+
+// eof
@@ -0,0 +1,136 @@
+// frames.h
+//
+// Framing of the musil --serve protocol, shared by the server and the client.
+// A frame is a header line "<kind> <size>\n" followed by size bytes. Clients
+// send "eval" frames; for each form of the code the server answers with an
+// "output" frame if the form printed anything, then a "result" frame (the
+// printed value) or an "error" frame (the message, the remaining forms are
+// skipped), and ends every request with "done 0\n". Frames larger than the
+// limit of the reader are rejected: read fails and oversized () is true.
+
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+constexpr std::size_t MAX_FRAME = 64 << 20; // bytes of payload accepted by default
+
+class FrameStream {
+public:
+	explicit FrameStream (int fd, std::size_t limit = MAX_FRAME) : _fd (fd), _limit (limit) {}
+	bool oversized () const { return _oversized; }
+	bool read (std::string& kind, std::string& payload) {
+		std::string header;
+		char c = 0;
+		while (get (c) && c != '\n') {
+			header += c;
+			if (header.size () > 64) return false; // not a header
+		}
+		if (c != '\n') return false;
+		std::size_t space = header.find (' ');
+		if (space == std::string::npos) return false;
+		kind = header.substr (0, space);
+		char* end = nullptr;
+		unsigned long long size = strtoull (header.c_str () + space + 1, &end, 10);
+		if (*end) return false;
+		if (size > _limit) {
+			_oversized = true;
+			return false;
+		}
+		payload.clear ();
+		payload.reserve (size);
+		while (payload.size () < size) {
+			if (_pos == _end && !fill ()) return false;
+			std::size_t n = std::min<std::size_t> (size - payload.size (), _end - _pos);
+			payload.append (_buf + _pos, n);
+			_pos += n;
+		}
+		return true;
+	}
+	bool write (const std::string& kind, const std::string& payload) {
+		std::string frame = kind + " " + std::to_string (payload.size ()) + "\n" + payload;
+		const char* p = frame.data ();
+		std::size_t left = frame.size ();
+		while (left) {
+			ssize_t n = ::send (_fd, p, left, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			p += n;
+			left -= n;
+		}
+		return true;
+	}
+private:
+	bool get (char& c) {
+		if (_pos == _end && !fill ()) return false;
+		c = _buf[_pos++];
+		return true;
+	}
+	bool fill () {
+		ssize_t n;
+		do n = ::recv (_fd, _buf, sizeof (_buf), 0); while (n < 0 && errno == EINTR);
+		if (n <= 0) return false;
+		_pos = 0;
+		_end = n;
+		return true;
+	}
+	int _fd;
+	std::size_t _limit;
+	bool _oversized = false;
+	char _buf[4096];
+	std::size_t _pos = 0, _end = 0;
+};
+
+// sockets: -1 on failure, errno tells why
+inline int unix_socket (const std::string& path, bool listening) {
+	sockaddr_un addr {};
+	if (path.size () >= sizeof (addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	addr.sun_family = AF_UNIX;
+	path.copy (addr.sun_path, path.size ());
+	int fd = ::socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (listening) {
+		::unlink (path.c_str ()); // stale socket of a previous server
+		if (::bind (fd, (sockaddr*) &addr, sizeof (addr)) == 0 && ::listen (fd, 64) == 0) return fd;
+	} else if (::connect (fd, (sockaddr*) &addr, sizeof (addr)) == 0) return fd;
+	::close (fd);
+	return -1;
+}
+inline void no_delay (int fd) { // frames are small: send them at once
+	int yes = 1;
+	setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof (yes));
+}
+inline int tcp_socket (int port, bool listening) { // localhost only
+	sockaddr_in addr {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons (port);
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	int fd = ::socket (AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (listening) {
+		int yes = 1;
+		setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof (yes));
+		if (::bind (fd, (sockaddr*) &addr, sizeof (addr)) == 0 && ::listen (fd, 64) == 0) return fd;
+	} else if (::connect (fd, (sockaddr*) &addr, sizeof (addr)) == 0) {
+		no_delay (fd);
+		return fd;
+	}
+	::close (fd);
+	return -1;
+}
+
+#endif // FRAMES_H
+
+// eof
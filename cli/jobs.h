@@ -0,0 +1,111 @@
+// jobs.h
+//
+// musil --jobs n: runs many scripts on n worker threads, each script in its
+// own fork of an environment initialized once (fork_env). The output of a
+// script is collected and written when it ends, with every line prefixed by
+// the script name, or to <dir>/<name>.out and <dir>/<name>.err with
+// --output-dir; scripts with the same name are numbered by their position.
+// A script fails if load reports an error while it runs or if its output
+// cannot be written; (exit) ends the script, not the batch. Each script starts
+// from the settings left by the preloaded files: its (precision) and
+// (info folds on|off) are its own (see ScriptIO), while (threads), (info stats
+// ...) and (info memory ...) change the whole process, so the other scripts too.
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "musil.h"
+
+#include <thread>
+#include <fstream>
+#include <map>
+
+struct JobResult {
+	std::string out, err;
+	bool failed = false;
+};
+JobResult run_job (const std::string& fname, AtomPtr base) {
+	std::stringstream out, err;
+	ScriptIO io {&out, &err};
+	script_io = &io;
+	try {
+		load (fname, fork_env (base));
+	} catch (ExitException&) { // (exit) ends the script only
+	} catch (std::exception& e) {
+		err << e.what () << std::endl;
+		++io.errors;
+	}
+	script_io = nullptr;
+	return JobResult {out.str (), err.str (), io.errors > 0};
+}
+void prefix_lines (const std::string& name, const std::string& text, std::ostream& out) {
+	std::size_t pos = 0;
+	while (pos < text.size ()) {
+		std::size_t next = text.find ('\n', pos);
+		if (next == std::string::npos) next = text.size (); // last line has no newline
+		out << name << ": ";
+		out.write (text.data () + pos, next - pos) << "\n";
+		pos = next + 1;
+	}
+}
+std::string job_name (const std::string& fname) { // file name without folders and extension
+	std::size_t slash = fname.find_last_of ("/\\");
+	std::string name = slash == std::string::npos ? fname : fname.substr (slash + 1);
+	std::size_t dot = name.rfind ('.');
+	return dot == std::string::npos || dot == 0 ? name : name.substr (0, dot);
+}
+std::vector<std::string> job_names (const std::vector<std::string>& files) { // a/x.scm, b/x.scm -> x.1, x.2
+	std::vector<std::string> names;
+	std::map<std::string, unsigned> count;
+	for (auto& f : files) names.push_back (job_name (f));
+	for (auto& n : names) ++count[n];
+	for (std::size_t i = 0; i < names.size (); ++i) {
+		if (count[names[i]] > 1) names[i] += "." + std::to_string (i + 1);
+	}
+	return names;
+}
+bool write_file (const std::string& fname, const std::string& text) {
+	std::ofstream out (fname);
+	out << text;
+	out.close ();
+	return !out.fail ();
+}
+// returns the number of failed scripts
+unsigned run_jobs (const std::vector<std::string>& files, AtomPtr base, unsigned workers,
+	const std::string& output_dir) {
+	std::vector<std::string> names = job_names (files);
+	std::atomic<std::size_t> next {0};
+	std::atomic<unsigned> failed {0};
+	std::mutex lock; // one script reported at a time
+	exit_throws = true;
+	auto worker = [&] () {
+		for (std::size_t i = next++; i < files.size (); i = next++) {
+			JobResult r = run_job (files[i], base);
+			const std::string& name = names[i];
+			if (output_dir.size ()) {
+				std::string path = output_dir + "/" + name;
+				bool written = write_file (path + ".out", r.out) && write_file (path + ".err", r.err);
+				if (!written || r.failed) {
+					std::lock_guard<std::mutex> g (lock);
+					std::cerr << files[i] << ": " << (written ? "failed" : "cannot write on " + path + ".*") << std::endl;
+				}
+				r.failed = r.failed || !written;
+			} else {
+				std::lock_guard<std::mutex> g (lock);
+				prefix_lines (name, r.out, std::cout);
+				std::cout.flush ();
+				prefix_lines (name, r.err, std::cerr);
+			}
+			if (r.failed) ++failed;
+		}
+	};
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < std::max (1u, workers); ++i) threads.emplace_back (worker);
+	worker (); // the calling thread is a worker too
+	for (auto& t : threads) t.join ();
+	return failed;
+}
+
+#endif // JOBS_H
+
+// eof
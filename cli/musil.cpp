@@ -2,9 +2,12 @@
 //
 
 #include "musil.h"
+#include "server.h"
+#include "jobs.h"
 #include <iostream>
 #include <stdexcept>
 #include <unistd.h>
+#include <getopt.h>
 
 using namespace std;
 
@@ -25,17 +28,52 @@ int main (int argc, char* argv[]) {
 	AtomPtr env = make_env ();
 	try {
 		bool interactive = false;
+		bool profile = false;
+		std::string profile_file = "musil.folded";
+		std::string socket_path;
+		int port = 0;
+		unsigned jobs = 0;
+		std::vector<std::string> preload;
+		std::string output_dir;
+		static struct option long_options[] = {
+			{"profile", optional_argument, nullptr, 'p'},
+			{"serve", required_argument, nullptr, 's'},
+			{"port", required_argument, nullptr, 't'},
+			{"jobs", required_argument, nullptr, 'j'},
+			{"preload", required_argument, nullptr, 'l'},
+			{"output-dir", required_argument, nullptr, 'o'},
+			{nullptr, 0, nullptr, 0}
+		};
 		int opt = 0;
-		while ((opt = getopt(argc, argv, "i")) != -1) {
+		while ((opt = getopt_long(argc, argv, "i", long_options, nullptr)) != -1) {
 		    switch (opt) {
 		    case 'i': interactive = true; break;
+		    case 'p':
+		        profile = true;
+		        if (optarg) profile_file = optarg;
+		        break;
+		    case 's': socket_path = optarg; break;
+		    case 't': port = atoi (optarg); break;
+		    case 'j': jobs = std::max (1, atoi (optarg)); break;
+		    case 'l': preload.push_back (optarg); break;
+		    case 'o': output_dir = optarg; break;
 		    default:
 		        std::stringstream msg;
-		        msg << "usage is " << argv[0] << " [-i] [file...]";
+		        msg << "usage is " << argv[0] << " [-i] [--profile[=file]] [--serve socket [--port n]] "
+		            << "[--jobs n [--preload file] [--output-dir dir]] [file...]";
 		        throw runtime_error (msg.str ());
 		    }
 		}
-		if (argc - optind == 0) {
+		if (jobs) { // every file runs in its own fork of env
+			for (const std::string& f : preload) load (f, env);
+			std::vector<std::string> files (argv + optind, argv + argc);
+			return run_jobs (files, env, jobs, output_dir) ? 1 : 0;
+		} else if (socket_path.size ()) { // files warm up the served environment
+			for (int i = optind; i < argc; ++i) {
+				load (argv[i], env);
+			}
+			serve (env, socket_path, port);
+		} else if (argc - optind == 0) {
 			cout << BOLDBLUE << "[musil, version "
 				<< VERSION <<"]" << RESET << endl << endl;
 
@@ -44,9 +82,19 @@ int main (int argc, char* argv[]) {
 
 			repl (cin, cout, env);
 		} else {
+			Profiler profiler;
+			if (profile) { // samples the files, not the interactive session
+				active_profiler = &profiler;
+				profiler.start ();
+			}
 			for (int i = optind; i < argc; ++i) {
 				load (argv[i], env);
 			}
+			if (profile) {
+				profiler.stop ();
+				active_profiler = nullptr;
+				write_profile (profiler, profile_file, cerr);
+			}
 			if (interactive) repl (cin, cout, env);
 		}
 	} catch (AtomPtr& e) {
@@ -0,0 +1,132 @@
+// musil_client.cpp
+//
+// Client of musil --serve: sends code (-e, files or stdin) and prints what it
+// printed and the results, one per line; errors go to stderr and set the
+// exit status. With
+// --bench it measures the throughput of a server instead, sending the same
+// request (default (+ 1 2)) from several concurrent connections.
+
+#include "frames.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <getopt.h>
+
+using namespace std;
+
+int connect_server (const string& path, int port) {
+	int fd = port > 0 ? tcp_socket (port, false) : unix_socket (path, false);
+	if (fd < 0) throw runtime_error ("cannot connect to " + (port > 0 ? "port " + to_string (port) : path)
+		+ ": " + strerror (errno));
+	return fd;
+}
+// sends one request; results go to out, errors to err; false on error
+bool request (FrameStream& io, const string& code, ostream* out, ostream* err) {
+	if (!io.write ("eval", code)) throw runtime_error ("connection lost");
+	bool ok = true;
+	string kind, payload;
+	while (io.read (kind, payload)) {
+		if (kind == "done") return ok;
+		if (kind == "error") {
+			ok = false;
+			if (err) *err << "error: " << payload << endl;
+		} else if (kind == "output") {
+			if (out) *out << payload;
+		} else if (out) *out << payload << "\n";
+	}
+	throw runtime_error ("connection lost");
+}
+void bench (const string& path, int port, const string& code, long requests, int clients) {
+	vector<thread> threads;
+	atomic<long> failed {0};
+	chrono::steady_clock::time_point t0 = chrono::steady_clock::now ();
+	for (int c = 0; c < clients; ++c) {
+		threads.emplace_back ([&, c] () {
+			try {
+				int fd = connect_server (path, port);
+				FrameStream io (fd);
+				for (long i = c; i < requests; i += clients) { // requests split across connections
+					if (!request (io, code, nullptr, nullptr)) ++failed;
+				}
+				close (fd);
+			} catch (exception& e) {
+				cerr << e.what () << endl;
+				++failed;
+			}
+		});
+	}
+	for (auto& t : threads) t.join ();
+	double secs = chrono::duration<double> (chrono::steady_clock::now () - t0).count ();
+	cout << requests << " requests on " << clients << " connections in " << secs << " s: "
+		<< requests / secs << " requests/s, " << 1e6 * secs * clients / requests << " us per request"
+		<< (failed ? ", " + to_string (failed) + " failed" : "") << endl;
+}
+
+int main (int argc, char* argv[]) {
+	int port = 0;
+	long requests = 0;
+	int clients = 1;
+	vector<string> codes;
+	static struct option long_options[] = {
+		{"port", required_argument, nullptr, 'p'},
+		{"bench", required_argument, nullptr, 'b'},
+		{"clients", required_argument, nullptr, 'c'},
+		{nullptr, 0, nullptr, 0}
+	};
+	int opt = 0;
+	while ((opt = getopt_long (argc, argv, "e:p:", long_options, nullptr)) != -1) {
+		switch (opt) {
+		case 'e': codes.push_back (optarg); break;
+		case 'p': port = atoi (optarg); break;
+		case 'b': requests = atol (optarg); break;
+		case 'c': clients = max (1, atoi (optarg)); break;
+		default:
+			cerr << "usage is " << argv[0] << " (socket | --port n) [-e code] [file...]\n"
+				<< "         " << argv[0] << " (socket | --port n) --bench requests [--clients n] [-e code]" << endl;
+			return 2;
+		}
+	}
+	string path;
+	if (port == 0) {
+		if (optind == argc) {
+			cerr << "no socket given" << endl;
+			return 2;
+		}
+		path = argv[optind++];
+	}
+	try {
+		if (requests > 0) {
+			bench (path, port, codes.size () ? codes[0] : "(+ 1 2)", requests, clients);
+			return 0;
+		}
+		for (int i = optind; i < argc; ++i) {
+			ifstream in (argv[i]);
+			if (!in.good ()) throw runtime_error (string ("cannot open input file ") + argv[i]);
+			stringstream text;
+			text << in.rdbuf ();
+			codes.push_back (text.str ());
+		}
+		if (codes.empty ()) {
+			stringstream text;
+			text << cin.rdbuf ();
+			codes.push_back (text.str ());
+		}
+		int fd = connect_server (path, port);
+		FrameStream io (fd, numeric_limits<size_t>::max ()); // results can be large
+		bool ok = true;
+		for (const string& code : codes) ok = request (io, code, &cout, &cerr) && ok;
+		close (fd);
+		return ok ? 0 : 1;
+	} catch (exception& e) {
+		cerr << e.what () << endl;
+		return 1;
+	}
+}
+
+// eof
@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# serve_bench.sh musil musil_client
+#
+# Starts musil --serve on a temporary socket, checks results, errors and the
+# isolation of the clients, then measures the request throughput with one
+# and with several concurrent connections.
+
+musil=$1
+client=$2
+sock=${TMPDIR:-/tmp}/musil_serve_bench.$$
+"$musil" --serve "$sock" 2>/dev/null &
+server=$!
+trap 'kill $server 2>/dev/null; rm -f "$sock"' EXIT
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -S "$sock" ] && break
+	sleep 0.1
+done
+
+fail=0
+check () { # check expected code...
+	expected=$1
+	shift
+	got=$("$client" "$sock" "$@" 2>&1)
+	if [ "$got" != "$expected" ]; then
+		echo "FAIL: $* -> $got (expected $expected)"
+		fail=1
+	fi
+}
+check "3" -e "(+ 1 2)"
+check "5
+7" -e "(def x 5) (+ x 2)"
+check "error: unbound identifier -> x" -e "x"   # definitions stay in their connection
+check "1
+2" -e "(def y 1)" -e "(+ y 1)"             # but persist between its requests
+check "hi
+1" -e "{ (print \"hi\\n\") 1 }"           # printed output goes to the client
+check "2
+2" -e "(def z 2) z (exit) z"             # exit ends the connection only
+check "3" -e "(+ 1 2)"
+[ $fail -eq 0 ] && echo "protocol checks passed"
+
+"$client" "$sock" --bench 20000
+"$client" "$sock" --bench 100000 --clients 8
+exit $fail
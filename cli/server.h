@@ -0,0 +1,109 @@
+// server.h
+//
+// musil --serve: keeps the environment warm after loading the files given on
+// the command line and evaluates framed requests (see frames.h) from local
+// clients. Every connection runs on its own thread, in a fork of that
+// environment (fork_env), so definitions persist between the requests of a
+// client and are invisible to the others. What a request prints is sent to
+// its client; (exit) closes the connection, not the server.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "musil.h"
+#include "frames.h"
+
+#include <thread>
+#include <cstring>
+#include <poll.h>
+
+// sends what the forms printed since the last call, if anything
+bool send_output (FrameStream& io, std::stringstream& printed) {
+	flush_output ();
+	std::string text = printed.str ();
+	if (text.empty ()) return true;
+	printed.str ("");
+	return io.write ("output", text);
+}
+void serve_client (int fd, AtomPtr base) {
+	FrameStream io (fd);
+	std::stringstream printed;
+	ScriptIO sio {&printed, &printed};
+	script_io = &sio;
+	try {
+		AtomPtr env = fork_env (base);
+		ForkScope fork (env);
+		std::string kind, code;
+		bool open = true;
+		while (open && io.read (kind, code)) {
+			bool sent = true;
+			if (kind != "eval") {
+				sent = io.write ("error", "unknown request " + kind);
+			} else {
+				std::istringstream in (code);
+				unsigned linenum = 0;
+				while (sent) {
+					try {
+						AtomPtr l = read (in, linenum);
+						if (!l && in.eof ()) break;
+						if (!l) continue;
+						std::stringstream out;
+						print (eval (l, env), out);
+						sent = send_output (io, printed) && io.write ("result", out.str ());
+					} catch (ExitException&) { // ends the connection, not the server
+						open = false;
+						break;
+					} catch (std::exception& e) {
+						sent = send_output (io, printed) && io.write ("error", e.what ());
+						break;
+					} catch (...) {
+						sent = send_output (io, printed) && io.write ("error", "unknown error detected");
+						break;
+					}
+				}
+				sent = sent && send_output (io, printed);
+			}
+			if (!sent || !io.write ("done", "")) break;
+		}
+		if (io.oversized ()) io.write ("error", "frame too large (limit " + std::to_string (MAX_FRAME) + " bytes)");
+	} catch (std::exception& e) { // e.g. out of memory: drop the client, keep serving
+		std::cerr << "[serve] " << e.what () << std::endl;
+	} catch (...) {
+		std::cerr << "[serve] unknown error detected" << std::endl;
+	}
+	script_io = nullptr;
+	::close (fd);
+}
+// listens on a Unix socket and, if port > 0, on localhost:port; throws on failure
+void serve (AtomPtr base, const std::string& path, int port) {
+	exit_throws = true;
+	std::vector<pollfd> listeners;
+	int fd = unix_socket (path, true);
+	if (fd < 0) throw std::runtime_error ("cannot listen on " + path + ": " + strerror (errno));
+	listeners.push_back ({fd, POLLIN, 0});
+	if (port > 0) {
+		fd = tcp_socket (port, true);
+		if (fd < 0) throw std::runtime_error ("cannot listen on port " + std::to_string (port) + ": " + strerror (errno));
+		listeners.push_back ({fd, POLLIN, 0});
+	}
+	std::cerr << "[serve] listening on " << path;
+	if (port > 0) std::cerr << " and 127.0.0.1:" << port;
+	std::cerr << std::endl;
+	while (true) {
+		if (::poll (listeners.data (), listeners.size (), -1) < 0) {
+			if (errno == EINTR) continue;
+			throw std::runtime_error (std::string ("[serve] poll: ") + strerror (errno));
+		}
+		for (std::size_t i = 0; i < listeners.size (); ++i) {
+			if (!(listeners[i].revents & POLLIN)) continue;
+			int client = ::accept (listeners[i].fd, nullptr, nullptr);
+			if (client < 0) continue;
+			if (i > 0) no_delay (client);
+			std::thread (serve_client, client, base).detach ();
+		}
+	}
+}
+
+#endif // SERVER_H
+
+// eof
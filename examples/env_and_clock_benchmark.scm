@@ -1,7 +1,7 @@
 ;; env_and_clock_benchmark.scm
 ;;
-;; Uses clock() to time a numeric operation,
-;; and getvar to show environment info.
+;; Uses clock() (CPU time) and now (wall time, ns) to time a numeric
+;; operation, and getvar to show environment info.
 
 (load "stdlib.scm")
 
@@ -13,6 +13,7 @@
 (print "benchmark: sum of first 1e6 integers\n")
 
 (def start (clock))
+(def wall (now))
 
 (def i   0)
 (def sum 0)
@@ -29,7 +30,9 @@
 })
 
 (def stop (clock))
+(def wall (- (now) wall))
 
 (print "result sum = " sum "\n")
 (print "clock ticks elapsed = " (- stop start) "\n")
-(print "Note: clock is CPU time, not wall clock.\n\n")
+(print "wall time elapsed = " (/ wall 1e6) " ms\n")
+(print "Note: clock is CPU time, now is wall time.\n\n")
@@ -0,0 +1,29 @@
+;; f32_benchmark.scm
+;;
+;; Elementwise arithmetic and reductions on 4M samples stored as f64 and as
+;; f32. f32 arrays take half the memory and stay f32 through operations
+;; with scalars and other f32 arrays.
+
+(load "stdlib.scm")
+
+(print "=== f32_benchmark.scm ===\n\n")
+
+(def n 4000000)
+(def x64 (bpf 0 n 1))
+(def x32 (f32 x64))
+
+(function run (x)
+  (sum (+ (* x 0.5) (sqrt x))))
+
+(def start (clock))
+(run x64)
+(def t64 (- (clock) start))
+
+(def start (clock))
+(run x32)
+(def t32 (- (clock) start))
+
+(print "f64 clock ticks = " t64 "\n")
+(print "f32 clock ticks = " t32 "\n")
+
+;; eof
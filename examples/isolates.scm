@@ -0,0 +1,49 @@
+;; isolates.scm
+;;
+;; A two-stage pipeline: a producer isolate renders blocks of noise, a
+;; consumer isolate measures their energy. Each isolate runs on its own
+;; thread over a private copy of the environment; blocks travel through
+;; channels by reference.
+
+(load "stdlib.scm")
+
+(print "=== isolates.scm ===\n\n")
+
+(def blocks (channel 'array 4))     ; bounded: the producer waits for the consumer
+(def results (channel))
+
+(function produce (n size) {
+  (def i 0)
+  (while (< i n) {
+    (send blocks (rand size))
+    (= i (+ i 1))
+  })
+  (close blocks)
+  n
+})
+
+(function consume () {
+  (def x (recv blocks))
+  (while (eq (info 'typeof x) '(array)) {
+    (send results (dot x x))
+    (= x (recv blocks))
+  })
+  (close results)
+})
+
+(def start (clock))
+(def p (isolate produce 64 65536))
+(def c (isolate consume))
+
+(def total 0)
+(def e (recv results))
+(while (eq (info 'typeof e) '(array)) {
+  (= total (+ total e))
+  (= e (recv results))
+})
+(print "blocks produced = " (join p) "\n")
+(join c)
+(print "total energy = " total "\n")
+(print "clock ticks elapsed = " (- (clock) start) "\n")
+
+;; eof
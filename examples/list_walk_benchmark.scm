@@ -0,0 +1,24 @@
+;; list_walk_benchmark.scm
+;;
+;; Recursive cdr walk over a 100k-element list. cdr is an lrange slice,
+;; which shares the nodes of the original list instead of copying it.
+
+(load "stdlib.scm")
+
+(print "=== list_walk_benchmark.scm ===\n\n")
+
+(def l (array2list (bpf 0 100000 100000)))
+
+(function walk (l n)
+  (if (eq l '())
+      n
+      (walk (cdr l) (+ n 1))))
+
+(def start (clock))
+(def n (walk l 0))
+(def stop (clock))
+
+(print "elements walked = " n "\n")
+(print "clock ticks elapsed = " (- stop start) "\n")
+
+;; eof
@@ -0,0 +1,37 @@
+;; pmap_benchmark.scm
+;;
+;; Renders 64 independent "voices" (one second of additive synthesis
+;; each) with map and with pmap, timed with the wall clock (now):
+;;
+;;   MUSIL_MAP=map  musil pmap_benchmark.scm
+;;   MUSIL_MAP=pmap musil pmap_benchmark.scm
+
+(load "stdlib.scm")
+
+(def sr 44100)
+(def t (/ (bpf 0 sr sr) sr))
+
+(function voice (f) {
+  (def out (* t 0))
+  (def k 1)
+  (while (<= k 8) {
+    (= out (+ out (/ (sin (* TWOPI f k t)) k)))
+    (= k (+ k 1))
+  })
+  (max (abs out))
+})
+
+(def freqs (map (lambda (i) (* 55 (+ 1 (/ i 8)))) (array2list (bpf 0 64 64))))
+(def mode (getvar "MUSIL_MAP"))
+
+(print "=== pmap_benchmark.scm (" (getval (threads) 0) " threads) ===\n")
+(def start (now))
+(def peaks
+  (if (eq mode "map")
+      (map voice freqs)
+      (pmap voice freqs)))
+(def elapsed (/ (- (now) start) 1e6))
+(print "mode: " (if (eq mode "map") "map" "pmap") ", peak sum: " (sum (apply array peaks)) "\n")
+(print "wall time: " elapsed " ms\n")
+
+;; eof
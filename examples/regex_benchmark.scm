@@ -0,0 +1,32 @@
+;; regex_benchmark.scm
+;;
+;; Parses 20000 score lines with str regex, first passing the pattern as a
+;; string (compiled once, then found in the regex cache) and then as a
+;; precompiled regex atom.
+
+(load "stdlib.scm")
+
+(print "=== regex_benchmark.scm ===\n\n")
+
+(def line "note=60 vel=100 dur=0.25")
+(def pattern "note=([0-9]+) vel=([0-9]+)")
+(def n 20000)
+
+(function parse (pat k)
+  (while (> k 0) {
+    (str 'regex line pat)
+    (= k (- k 1))
+  }))
+
+(def start (clock))
+(parse pattern n)
+(print "string pattern, clock ticks = " (- (clock) start) "\n")
+
+(def rx (regex pattern))
+(def start (clock))
+(parse rx n)
+(print "regex atom, clock ticks = " (- (clock) start) "\n")
+
+(print "all fields: " (str 'match-all line "([a-z]+)=([0-9.]+)") "\n")
+
+;; eof
@@ -0,0 +1,29 @@
+;; save_benchmark.scm
+;;
+;; Saves a 1M-element array and prints it to a string, at the default
+;; precision (6 significant digits) and at precision 0 (shortest exact
+;; form, the saved file reads back to the same values).
+
+(load "stdlib.scm")
+
+(print "=== save_benchmark.scm ===\n\n")
+
+(def x (rand 1000000))
+(def fname "/tmp/musil_save_benchmark.txt")
+
+(def start (clock))
+(save fname x)
+(print "save, clock ticks             = " (- (clock) start) "\n")
+
+(def start (clock))
+(def s (tostr x))
+(print "tostr, clock ticks            = " (- (clock) start) "\n")
+
+(precision 0)
+(def start (clock))
+(save fname x)
+(print "save (precision 0), clock ticks = " (- (clock) start) "\n")
+(print "read back equal: " (eq (eval (car (read fname))) x) "\n")
+(precision 6)
+
+;; eof
@@ -0,0 +1,30 @@
+;; scheduler_jitter.scm
+;;
+;; Schedules 400 events 5 ms apart (200 events per second), cancels every
+;; fourth one and reports the scheduler statistics: fired, pending and
+;; cancelled events, and the mean, max and standard deviation of the
+;; lateness of each event in microseconds.
+
+(load "stdlib.scm")
+
+(print "=== scheduler_jitter.scm ===\n\n")
+
+(def n 400)
+(def fired 0)
+
+(info 'scheduler 'reset)
+(def start (clock))
+(def k 0)
+(while (< k n) {
+  (def e (schedule (lambda () (= fired (+ fired 1))) (* k 5)))
+  (if (== (mod k 4) 0) (cancel e) ())
+  (= k (+ k 1))
+})
+(print "scheduling, clock ticks = " (- (clock) start) "\n")
+
+(sleep (+ (* n 5) 100))
+(def s (info 'scheduler))
+(print "fired = " (getval s 0) ", pending = " (getval s 1) ", cancelled = " (getval s 2) "\n")
+(print "jitter (us): mean = " (getval s 3) ", max = " (getval s 4) ", stddev = " (getval s 5) "\n")
+
+;; eof
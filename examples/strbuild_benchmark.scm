@@ -0,0 +1,38 @@
+;; strbuild_benchmark.scm
+;;
+;; Builds a 20000-field CSV line three ways: repeated tostr concatenation
+;; (copies the whole line at every step), appends to a strbuild buffer and
+;; a single strjoin over the list of fields.
+
+(load "stdlib.scm")
+
+(print "=== strbuild_benchmark.scm ===\n\n")
+
+(def n 20000)
+(def fields (array2list (bpf 0 n n)))
+
+(def start (clock))
+(def csv (tostr (car fields)))
+(def l (cdr fields))
+(while (> (llength l) 0) {
+  (= csv (tostr csv "," (car l)))
+  (= l (cdr l))
+})
+(print "tostr, clock ticks    = " (- (clock) start) "\n")
+
+(def start (clock))
+(def buf (strbuild (strbuild) (car fields)))
+(def l (cdr fields))
+(while (> (llength l) 0) {
+  (strbuild buf "," (car l))
+  (= l (cdr l))
+})
+(print "strbuild, clock ticks = " (- (clock) start) "\n")
+
+(def start (clock))
+(def joined (strjoin fields ","))
+(print "strjoin, clock ticks  = " (- (clock) start) "\n")
+
+(print "same result: " (eq csv buf) (eq buf joined) "\n")
+
+;; eof
@@ -0,0 +1,31 @@
+;; tempo_clock.scm
+;;
+;; A swung hi-hat pattern on a tempo clock. Every event is placed on an
+;; absolute beat of the clock, so the pattern does not drift the way
+;; chained (sleep ...) calls do; the tempo changes half way through.
+
+(load "stdlib.scm")
+
+(print "=== tempo_clock.scm ===\n\n")
+
+(def clock-120 (tempo 120 0.33))   ; 120 bpm, swung eighths
+
+(function hit (beat)
+  (print "beat " beat " at " (time->beat clock-120) "\n"))
+
+(def b 1)
+(while (<= b 4) {
+  (schedule-beat (lambda () (hit b)) b clock-120)
+  (schedule-beat (lambda () (hit (+ b 0.5))) (+ b 0.5) clock-120)
+  (= b (+ b 1))
+})
+(sleep-until (beat->time clock-120 4.75))
+(setbpm clock-120 180)
+(print "tempo change at beat " (time->beat clock-120) "\n")
+(schedule-beat (lambda () (hit 6)) 6 clock-120)
+(sleep-until (beat->time clock-120 6.25))
+
+(def s (info 'scheduler))
+(print "jitter (us): mean = " (getval s 3) ", max = " (getval s 4) "\n")
+
+;; eof
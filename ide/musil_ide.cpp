@@ -559,24 +559,25 @@ static const char* musil_builtin_keywords[] = {
     "*", "+", "-", "/",
     "<", "<=", "<>", "=", "==", ">", ">=",
     "E", "LOG2", "SQRT2", "TWOPI",
-    "abs", "acos", "ack", "addpaths", "and", "apply",
+    "abs", "acos", "ack", "addpaths", "and", "apply", "argmax", "argmin",
     "array", "array2list", "asin", "assign", "atan",
-    "begin", "break", "car", "cdr", "clearpaths", "clock", "comp",
-    "compare", "cos", "cosh", "def", "diff", "dirlist", "dot", "dup",
-    "elem", "eq", "eval", "exec", "exit", "fac", "fib", "filter",
+    "beat->time", "begin", "bench", "break", "cancel", "car", "cdr", "channel", "clearpaths", "clock", "close", "comp",
+    "compare", "cos", "cosh", "ddel", "def", "dget", "dhas", "dict", "diff",
+    "dirlist", "dkeys", "dot", "dset", "dtype", "dup",
+    "elem", "eq", "eval", "exec", "exit", "f32", "f64", "fac", "fib", "filter",
     "filestat", "flip", "floor", "foldl", "fourth", "function",
-    "getval", "getvar", "if", "info", "lambda",
+    "getval", "getvar", "hash", "if", "info", "isolate", "join", "lambda",
     "lappend", "lhead", "lindex", "length", "let", "list",
     "llast", "llength", "lrange", "lreplace", "lreverse", "lset",
     "lshuffle", "lsplit", "ltail", "ltake", "ldrop",
     "load", "log", "log10", "macro", "map", "map2", "match",
-    "max", "mean", "min", "mod", "neg", "normal", "not", "or",
-    "ortho", "pred", "print", "quotient", "read", "remainder",
-    "round", "save", "schedule", "second", "setval", "sign",
-    "sin", "sinh", "size", "slice", "sleep", "sqrt", "square",
-    "standard", "stddev", "str", "sum", "succ",
-    "tan", "tanh", "third", "tostr", "twice",
-    "udprecv", "udpsend", "unless", "when", "while", "zip"
+    "massign", "max", "mean", "memo", "min", "mod", "neg", "norm", "normal", "not", "now", "or",
+    "ortho", "pfor-each", "pmap", "precision", "pred", "print", "profile", "quotient", "read", "recv", "regex", "remainder",
+    "round", "save", "schedule", "schedule-beat", "second", "select", "send", "setbpm", "setval", "sign",
+    "sin", "sinh", "size", "slice", "sleep", "sleep-until", "sqrt", "square",
+    "standard", "stddev", "str", "strbuild", "strjoin", "sum", "succ",
+    "tan", "tanh", "tempo", "third", "threads", "time->beat", "tostr", "twice",
+    "udprecv", "udpsend", "unless", "variance", "when", "while", "zip"
 };
 
 const int N_BUILTIN_KEYWORDS =
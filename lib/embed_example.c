@@ -0,0 +1,39 @@
+/* embed_example.c
+ *
+ * Minimal C host of libmusil: evaluates code in a forked environment and
+ * exchanges arrays with it without copies, then loads the files given on
+ * the command line, in order, into another fork (used by the PGO training).
+ */
+
+#include "musil_c.h"
+#include <stdio.h>
+
+int main (int argc, char* argv[]) {
+	musil_env* base = musil_create ();
+	if (!base) return 1;
+	musil_env* job = musil_fork (base);
+
+	double* in = musil_new_array (job, "input", 4);
+	for (int i = 0; i < 4; ++i) in[i] = i + 1;
+	if (musil_eval (job, "(def output (* input input)) (sum output)") != 0) {
+		fprintf (stderr, "error: %s\n", musil_error (job));
+		return 1;
+	}
+	printf ("musil %s: sum = %s\n", musil_version (), musil_result (job));
+
+	const double* out = NULL;
+	size_t n = 0;
+	if (musil_get_array (job, "output", &out, &n) != 0) return 1;
+	for (size_t i = 0; i < n; ++i) printf ("%g ", out[i]);
+	printf ("\n");
+
+	musil_destroy (job);
+
+	musil_env* scripts = musil_fork (base);
+	for (int i = 1; i < argc; ++i) {
+		if (musil_load (scripts, argv[i]) != 0) fprintf (stderr, "%s: %s\n", argv[i], musil_error (scripts));
+	}
+	musil_destroy (scripts);
+	musil_destroy (base);
+	return 0;
+}
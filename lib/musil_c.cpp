@@ -0,0 +1,128 @@
+// musil_c.cpp
+//
+// libmusil: the whole interpreter compiled as one translation unit behind the
+// C interface of musil_c.h. Only that interface is exported.
+
+#include "musil.h"
+#include "musil_c.h"
+
+YieldFunction g_yield = nullptr;
+
+struct musil_env {
+	AtomPtr env;
+	std::string result;
+	std::string error;
+};
+
+static int fail (musil_env* e, const std::string& msg) {
+	e->error = msg;
+	return -1;
+}
+static AtomPtr bound_array (musil_env* e, const char* name) {
+	AtomPtr a = assoc (make_atom (std::string (name)), e->env);
+	if (a->type != ARRAY) error ("[musil_get_array] not an array", a);
+	if (a->f32) error ("[musil_get_array] float32 arrays are not shared", a);
+	return a;
+}
+
+extern "C" {
+
+const char* musil_version (void) {
+	return VERSION;
+}
+
+musil_env* musil_create (void) {
+	try {
+		exit_throws = true; // (exit) ends the script, never the host
+		return new musil_env {make_env (), "", ""};
+	} catch (...) {
+		return nullptr;
+	}
+}
+musil_env* musil_fork (musil_env* base) {
+	return new musil_env {fork_env (base->env), "", ""};
+}
+void musil_destroy (musil_env* env) {
+	delete env;
+}
+
+int musil_load (musil_env* e, const char* path) {
+	try {
+		e->result.clear ();
+		std::stringstream out;
+		print (load (path, e->env), out);
+		e->result = out.str ();
+		return 0;
+	} catch (ExitException&) {
+		return 1;
+	} catch (std::exception& err) {
+		return fail (e, err.what ());
+	} catch (...) {
+		return fail (e, "unknown error detected");
+	}
+}
+int musil_eval (musil_env* e, const char* code) {
+	try {
+		e->result.clear ();
+		ForkScope fork (e->env);
+		std::istringstream in (code);
+		unsigned linenum = 0;
+		AtomPtr r;
+		while (true) {
+			AtomPtr l = read (in, linenum);
+			if (!l && in.eof ()) break;
+			if (!l) continue;
+			r = eval (l, e->env);
+		}
+		flush_output ();
+		std::stringstream out;
+		print (r, out);
+		e->result = out.str ();
+		return 0;
+	} catch (ExitException&) {
+		flush_output ();
+		return 1;
+	} catch (std::exception& err) {
+		return fail (e, err.what ());
+	} catch (...) {
+		return fail (e, "unknown error detected");
+	}
+}
+const char* musil_result (musil_env* e) {
+	return e->result.c_str ();
+}
+const char* musil_error (musil_env* e) {
+	return e->error.c_str ();
+}
+
+int musil_get_array (musil_env* e, const char* name, const double** data, size_t* size) {
+	try {
+		AtomPtr a = bound_array (e, name); // the binding keeps the storage alive
+		*data = a->array.size () ? std::begin (a->array) : nullptr;
+		*size = a->array.size ();
+		return 0;
+	} catch (std::exception& err) {
+		return fail (e, err.what ());
+	}
+}
+double* musil_new_array (musil_env* e, const char* name, size_t size) {
+	try {
+		static double none; // storage of empty arrays: not null, never accessed
+		AtomPtr a = make_atom (std::valarray<Real> (0., size));
+		extend (make_atom (std::string (name)), a, e->env);
+		return size ? std::begin (a->array) : &none;
+	} catch (std::exception& err) {
+		fail (e, err.what ());
+		return nullptr;
+	}
+}
+int musil_put_array (musil_env* e, const char* name, const double* data, size_t size) {
+	double* dst = musil_new_array (e, name, size);
+	if (!dst) return -1;
+	std::copy (data, data + size, dst);
+	return 0;
+}
+
+} // extern "C"
+
+// eof
@@ -0,0 +1,55 @@
+// musil_c.h
+//
+// C interface of libmusil, for embedding the interpreter in C hosts.
+// Environments are opaque handles; every function returning int returns 0
+// on success and -1 on failure, musil_error () then describes the failure.
+// musil_load and musil_eval return 1 if the code called (exit): the rest of
+// it is skipped, the host keeps running.
+// Arrays are exchanged without copies: musil_get_array points into the
+// bound array and musil_new_array returns the storage of a new binding,
+// both valid until the name is rebound or the environment is destroyed
+// (for size 0 musil_new_array returns a pointer that must not be accessed).
+// An environment must be used by one thread at a time; forks of the same
+// base can run on different threads. Forking freezes the base: it and the
+// values bound in it can no longer be modified, forks shadow (def) and
+// overwrite (=) its bindings in their own frame.
+
+#ifndef MUSIL_C_H
+#define MUSIL_C_H
+
+#include <stddef.h>
+
+#if defined (_WIN32)
+#define MUSIL_API __declspec (dllexport)
+#else
+#define MUSIL_API __attribute__ ((visibility ("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct musil_env musil_env;
+
+MUSIL_API const char* musil_version (void);
+
+MUSIL_API musil_env* musil_create (void); // all primitives, no library loaded
+MUSIL_API musil_env* musil_fork (musil_env* base); // copy-on-write, see fork_env
+MUSIL_API void musil_destroy (musil_env* env);
+
+MUSIL_API int musil_load (musil_env* env, const char* path); // e.g. "stdlib.scm"
+MUSIL_API int musil_eval (musil_env* env, const char* code); // all forms in code
+MUSIL_API const char* musil_result (musil_env* env); // printed value of the last form
+MUSIL_API const char* musil_error (musil_env* env);
+
+MUSIL_API int musil_get_array (musil_env* env, const char* name, const double** data, size_t* size);
+MUSIL_API double* musil_new_array (musil_env* env, const char* name, size_t size);
+MUSIL_API int musil_put_array (musil_env* env, const char* name, const double* data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MUSIL_C_H
+
+// eof
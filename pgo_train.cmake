@@ -0,0 +1,39 @@
+# pgo_train.cmake
+#
+# Training run of a MUSIL_PGO=GENERATE build: runs the tests and the
+# self-terminating examples through the CLI and through the C library, and
+# the benchmark suite, so that every instrumented target writes its profile.
+# Invoked by the pgo-train target with SOURCE_DIR and the target paths.
+
+set(scripts
+    ${SOURCE_DIR}/tests/test_reader.scm
+    ${SOURCE_DIR}/tests/test_scientific.scm
+    ${SOURCE_DIR}/tests/test_core.scm
+    ${SOURCE_DIR}/examples/basic.scm
+    ${SOURCE_DIR}/examples/overview.scm
+    ${SOURCE_DIR}/examples/stress_test.scm
+    ${SOURCE_DIR}/examples/f32_benchmark.scm
+    ${SOURCE_DIR}/examples/list_walk_benchmark.scm
+    ${SOURCE_DIR}/examples/pmap_benchmark.scm
+    ${SOURCE_DIR}/examples/regex_benchmark.scm
+    ${SOURCE_DIR}/examples/strbuild_benchmark.scm
+)
+
+# run in a scratch folder holding the libraries, as scripts write files
+set(run ${CMAKE_CURRENT_BINARY_DIR}/pgo-run)
+file(COPY ${SOURCE_DIR}/src/stdlib.scm ${SOURCE_DIR}/src/core.scm ${SOURCE_DIR}/src/scientific.scm
+    DESTINATION ${run})
+foreach(script ${scripts})
+    message(STATUS "training on ${script}")
+    execute_process(COMMAND ${MUSIL} stdlib.scm ${script}
+        WORKING_DIRECTORY ${run} OUTPUT_QUIET TIMEOUT 600)
+endforeach()
+if(EMBED)
+    message(STATUS "training libmusil")
+    execute_process(COMMAND ${EMBED} stdlib.scm ${scripts}
+        WORKING_DIRECTORY ${run} OUTPUT_QUIET TIMEOUT 1200)
+endif()
+if(BENCH)
+    message(STATUS "training musil_bench")
+    execute_process(COMMAND ${BENCH} --min-time 0.3 OUTPUT_QUIET TIMEOUT 600)
+endif()
@@ -19,12 +19,26 @@
 #include <iterator>
 #include <functional>
 #include <unordered_map>
+#include <unordered_set>
+#include <list>
+#include <mutex>
 #include <cmath>
+#include <type_traits>
+#include <string_view>
+#include <charconv>
+#include <atomic>
+
+#include "core/kernels.h"
+#include "core/PVector.h"
+#include "core/parallel.h"
+#include "core/Scheduler.h"
+#include "core/Profiler.h"
+#include "core/OpStats.h"
 
 // yield function
 typedef void (*YieldFunction)();
 extern YieldFunction g_yield;
-inline void call_yield() { if (g_yield) g_yield (); }
+inline void call_yield() { if (g_yield && ThreadPool::worker_index () < 0) g_yield (); } // hosts yield on their own thread
 inline void set_yield(YieldFunction fn) { g_yield = fn; }
 
 // ast
@@ -42,21 +56,61 @@ struct StackGuard {
     }
 };
 #define make_atom(a)(std::make_shared<Atom> (a))
-enum AtomType {LIST, SYMBOL, STRING, ARRAY, LAMBDA, MACRO, OP};
-const char* ATOM_NAMES[] = {"list", "symbol", "string", "array", "lambda", "macro", "op"};
+enum AtomType : std::uint8_t {LIST, SYMBOL, STRING, ARRAY, LAMBDA, MACRO, OP, DICT, REGEX, NATIVE};
+const char* ATOM_NAMES[] = {"list", "symbol", "string", "array", "lambda", "macro", "op", "dict", "regex", "native"};
 bool is_string (const std::string& l);
 void error (const std::string& msg, AtomPtr n);
+struct Dict;
+struct Native { // payload of atoms wrapping native objects
+	virtual ~Native () {}
+};
+// memory accounting: atoms created while counting is on are counted, in total
+// and by their current type, until destroyed
+inline std::atomic<bool> g_count_atoms {false};
+inline std::atomic<long> g_live_atoms {0};
+inline std::atomic<std::size_t> g_made_atoms {0};
+inline std::atomic<long> g_live_types[NATIVE + 1] {};
+struct LiveType { // the type of an atom, see g_count_atoms
+	AtomType type;
+	bool counted = g_count_atoms.load (std::memory_order_relaxed);
+	explicit LiveType (AtomType t) : type (t) {
+		if (!counted) return;
+		g_live_atoms.fetch_add (1, std::memory_order_relaxed);
+		g_made_atoms.fetch_add (1, std::memory_order_relaxed);
+		g_live_types[t].fetch_add (1, std::memory_order_relaxed);
+	}
+	LiveType (const LiveType&) = delete;
+	LiveType& operator= (AtomType t) {
+		if (counted && t != type) {
+			g_live_types[type].fetch_sub (1, std::memory_order_relaxed);
+			g_live_types[t].fetch_add (1, std::memory_order_relaxed);
+		}
+		type = t;
+		return *this;
+	}
+	LiveType& operator= (const LiveType& t) { return *this = t.type; }
+	operator AtomType () const { return type; }
+	~LiveType () {
+		if (!counted) return;
+		g_live_atoms.fetch_sub (1, std::memory_order_relaxed);
+		g_live_types[type].fetch_sub (1, std::memory_order_relaxed);
+	}
+};
+struct AtomExtra { // payloads of a few atom types, kept out of Atom to keep it small
+	std::valarray<float> array32; // elements of f32 arrays (array is then empty)
+	std::shared_ptr<Dict> dict;
+	std::shared_ptr<Native> native;
+};
 struct Atom {
 	Atom () { type = LIST; }
 	Atom (std::string lex) {
-		lexeme = lex;
-		if (is_string (lexeme)) {
+		if (is_string (lex)) {
 			type = STRING;
-			lexeme = lex.substr (1, lex.size () - 1);
+			lex.erase (0, 1);
 		} else {
 			type = SYMBOL;
-			lexeme = lex;
 		}
+		lexeme = std::move (lex);
 	}
 	Atom (Real val) {
 		type = ARRAY;
@@ -70,6 +124,11 @@ struct Atom {
 		type = ARRAY;
 		array = std::move(a);
 	}
+	Atom (std::valarray<float>&& a) { // float32 storage
+		type = ARRAY;
+		array32 () = std::move(a);
+		f32 = true;
+	}
     Atom (const std::vector<Real>& v) {
 		type = ARRAY;
 		array = std::valarray<Real>(v.data(), v.size());
@@ -85,15 +144,64 @@ struct Atom {
 		type = OP;
 		op = f;
 	}
-	AtomType type;
+	// f32 arrays, dicts and natives only: made by the first call, read
+	// through extra where the atom may be of another type
+	std::valarray<float>& array32 () { return more ().array32; }
+	std::shared_ptr<Dict>& dict () { return more ().dict; }
+	std::shared_ptr<Native>& native () { return more ().native; }
+	AtomExtra& more () {
+		if (!extra) extra = std::make_unique<AtomExtra> ();
+		return *extra;
+	}
+	LiveType type {LIST};
+	std::uint32_t version = 0; // bumped by extend, see snapshot_env
 	std::string lexeme;
 	std::valarray<Real> array;
 	Functor op;
 	unsigned minargs;
-	std::vector <AtomPtr> tail;
+	unsigned line = 0; // source line of lists read from a stream, 0 if unknown
+	PVector<AtomPtr> tail; // persistent: copies and slices share nodes
 	std::vector<std::string> paths;
 	mutable std::unordered_map<std::string, AtomPtr> cache; // OPTIMIZATION: hash map cache for fast symbol lookup
+	std::unique_ptr<AtomExtra> extra; // OPTIMIZATION: one pointer for the rarely used payloads
 	mutable bool cache_valid = false;
+	bool f32 = false; // elements are in array32
+	bool forked = false; // environment made by fork_env
+	bool frozen = false; // shared read-only between threads, see freeze
+	bool inlined = false; // constant that fold may inline, see fold_release
+	bool buffer = false; // string made by strbuild, appended in place
+};
+inline AtomPtr make_native (const std::string& kind, std::shared_ptr<Native> p) { // handle atom
+	AtomPtr a = std::make_shared<Atom> ();
+	a->type = NATIVE;
+	a->lexeme = kind;
+	a->native () = std::move (p);
+	return a;
+}
+inline AtomPtr make_string (std::string text) { // STRING atom from raw text, no leading quote
+	AtomPtr a = std::make_shared<Atom> ();
+	a->type = STRING;
+	a->lexeme = std::move (text);
+	return a;
+}
+// dictionaries: keys are strings, symbols or scalars (exact value, -0 == 0)
+struct DictKey {
+	AtomType type;
+	std::string lexeme;
+	Real value;
+	bool operator== (const DictKey& k) const {
+		return type == k.type && value == k.value && lexeme == k.lexeme;
+	}
+};
+struct DictKeyHash {
+	std::size_t operator() (const DictKey& k) const {
+		std::size_t h = k.type == ARRAY ? std::hash<Real> () (k.value) : std::hash<std::string> () (k.lexeme);
+		return h ^ ((std::size_t) k.type * 0x9e3779b97f4a7c15ull);
+	}
+};
+struct Dict {
+	std::unordered_map<DictKey, std::size_t, DictKeyHash> index; // key -> entry
+	std::vector<std::pair<AtomPtr, AtomPtr> > entries; // insertion order, deletion moves the last entry
 };
 inline bool is_nil (AtomPtr e) { // OPTIMIZATION: inline
 	return (e == nullptr || (e->type == LIST && e->tail.size () == 0));
@@ -111,15 +219,73 @@ inline bool is_number (const std::string& tt) {
 	Real v; dummy >> v;
 	return dummy && dummy.eof ();
 }
-std::ostream& print_valarray(const std::valarray<Real>& v, std::ostream& out = std::cout) {
-    if (v.size () != 1) out << "[";
-    for (size_t i = 0; i < v.size(); ++i) {
-        out << v[i];    
-        if (i + 1 < v.size()) out << " ";
-    }
-    if (v.size () != 1) out << "]";
-	out.flush ();
-    return out;
+// numbers are formatted with std::to_chars using print_precision () significant
+// digits (as printf %g); 0 selects the shortest form that reads back exactly
+inline std::atomic<int> g_print_precision {6};
+// script output and settings: std::cout, std::cerr and the process-wide
+// settings unless the host runs scripts concurrently (musil --jobs, --serve)
+// and gives each thread its own streams and copy of the settings, taken from
+// the process-wide ones when it is made. Only (precision) and (info folds on|off)
+// are per script: (threads), (info stats ...) and (info memory ...) act on the
+// whole process
+struct ScriptIO {
+	std::ostream* out;
+	std::ostream* err;
+	unsigned errors = 0; // reported by load
+	int precision; // see fn_precision
+	bool folds; // see fold
+	ScriptIO (std::ostream* o, std::ostream* e);
+};
+inline thread_local ScriptIO* script_io = nullptr;
+inline int print_precision () { return script_io ? script_io->precision : g_print_precision.load (); }
+template <typename T>
+inline char* format_real (char* first, char* last, T v) {
+	int p = print_precision ();
+	return (p > 0 ? std::to_chars (first, last, v, std::chars_format::general, p)
+		: std::to_chars (first, last, v)).ptr;
+}
+template <typename T>
+std::ostream& print_valarray(const std::valarray<T>& v, std::ostream& out = std::cout) {
+	char buf[4096]; // written out in blocks, no flush (see flush_output)
+	char* p = buf;
+	char* last = buf + sizeof (buf);
+	if (v.size () != 1) *p++ = '[';
+	for (size_t i = 0; i < v.size(); ++i) {
+		if (last - p < 64) {
+			out.write (buf, p - buf);
+			p = buf;
+		}
+		p = format_real (p, last, v[i]);
+		if (i + 1 < v.size()) *p++ = ' ';
+	}
+	if (v.size () != 1) *p++ = ']';
+	out.write (buf, p - buf);
+	return out;
+}
+// (exit) ends the process, or only the running script when such a host
+// sets exit_throws: load passes ExitException on to it
+struct ExitException : public std::exception {
+	const char* what () const noexcept override { return "exit"; }
+};
+inline std::atomic<bool> exit_throws {false};
+inline std::ostream& output () { return script_io ? *script_io->out : std::cout; }
+inline std::ostream& error_output () { return script_io ? *script_io->err : std::cerr; }
+inline void flush_output () { // called at top level: after REPL and load forms, before sleeping
+	output ().flush ();
+}
+std::ostream& write_quoted (const std::string& s, std::ostream& out) { // as a string literal read back by read
+	out << '"';
+	for (char c : s) {
+		switch (c) {
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default: out << c;
+		}
+	}
+	return out << '"';
 }
 std::ostream& print (AtomPtr e, std::ostream& out, bool write = false) {
 	if (e != nullptr) { // to have () printed for nil
@@ -149,11 +315,12 @@ std::ostream& print (AtomPtr e, std::ostream& out, bool write = false) {
 			out << e->lexeme;
 		break;
 		case STRING:
-			if (write) out << "\"" << e->lexeme << "\"";
+			if (write) write_quoted (e->lexeme, out);
 			else out << e->lexeme;
 		break;
 		case ARRAY:
-			print_valarray (e->array, out);
+			if (e->f32) print_valarray (e->array32 (), out);
+			else print_valarray (e->array, out);
 		break;
 		case LAMBDA: case MACRO:
 			if (e->type == LAMBDA) out << "(lambda ";
@@ -165,9 +332,27 @@ std::ostream& print (AtomPtr e, std::ostream& out, bool write = false) {
 			if (write) out << e->lexeme;
 			else out << "<op @ " << (std::hex) << &e->op << ">";
 		break;
+		case DICT: // written as a (dict k v ...) call that rebuilds it
+			out << "(dict";
+			for (auto& kv : e->dict ()->entries) {
+				out << " ";
+				if (write && kv.first->type == SYMBOL) out << "'";
+				print (kv.first, out, write) << " ";
+				bool q = write && (kv.second->type == SYMBOL || (kv.second->type == LIST && kv.second->tail.size ()));
+				if (q) out << "(quote ";
+				print (kv.second, out, write);
+				if (q) out << ")";
+			}
+			out << ")";
+		break;
+		case REGEX: // written as the (regex "pattern") call that compiles it
+			write_quoted (e->lexeme, out << "(regex ") << ")";
+		break;
+		case NATIVE: // handles (channels, isolates, ...): lexeme is the kind
+			out << "<" << e->lexeme << " @ " << std::hex << e->native ().get () << std::dec << ">";
+		break;
 		}
 	}
-	out.flush ();
 	return out;
 }
 void error (const std::string& msg, AtomPtr n) {
@@ -195,12 +380,85 @@ inline AtomPtr args_check (AtomPtr node, unsigned args) {
 	if (node->tail.size () < args) error (err.str (), node);
 	return node;
 }
+// float32 arrays: element access independent of the storage type
+inline std::size_t array_size (const AtomPtr& a) {
+	return a->f32 ? a->array32 ().size () : a->array.size ();
+}
+inline Real array_value (const AtomPtr& a, std::size_t i) {
+	return a->f32 ? (Real) a->array32 ()[i] : a->array[i];
+}
+inline AtomPtr widened (const AtomPtr& a) { // f64 copy of an f32 array, a is left as is
+	std::valarray<Real> v (a->array32 ().size ());
+	for (std::size_t i = 0; i < v.size (); ++i) v[i] = a->array32 ()[i];
+	return make_atom (std::move (v));
+}
 inline AtomPtr type_check (AtomPtr node, AtomType t) {
-	std::stringstream err;
-	err << "invalid type (required " << ATOM_NAMES[t] << ", got " << ATOM_NAMES[node->type] << ")";
-	if (node->type != t) error (err.str (), node);
+	if (node->type != t) {
+		std::stringstream err;
+		err << "invalid type (required " << ATOM_NAMES[t] << ", got " << ATOM_NAMES[node->type] << ")";
+		error (err.str (), node);
+	}
+	if (t == ARRAY && node->f32) return widened (node); // primitives without f32 kernels work on f64
+	return node;
+}
+inline Real scalar_check (const AtomPtr& node) { // first element of an ARRAY, f32 arrays are not widened
+	if (node->type != ARRAY) type_check (node, ARRAY);
+	return array_value (node, 0);
+}
+void fold_release (const AtomPtr& value);
+struct SharedValues;
+inline thread_local SharedValues* shared_values = nullptr; // of the running pmap, see parallel_apply
+bool is_shared_value (const Atom* v);
+inline std::atomic<std::size_t> g_mutations {0}; // in-place changes of values, see snapshot_env
+inline AtomPtr mutable_check (AtomPtr node, const char* op) { // for primitives changing values in place
+	if (node->frozen) error (std::string ("[") + op + "] cannot modify a frozen value (shared between threads), copy it first", node);
+	if (shared_values && is_shared_value (node.get ())) {
+		error (std::string ("[") + op + "] cannot modify a value shared by parallel tasks, copy it first", node);
+	}
+	g_mutations.fetch_add (1, std::memory_order_relaxed);
+	if (node->inlined) fold_release (node);
 	return node;
 }
+template <typename T>
+T* native_check (AtomPtr node, const char* kind) { // payload of a NATIVE handle of the given kind
+	T* p = type_check (node, NATIVE)->lexeme == kind ? dynamic_cast<T*> (node->native ().get ()) : nullptr;
+	if (!p) error (std::string ("invalid type (required ") + kind + ", got " + node->lexeme + ")", node);
+	return p;
+}
+template <typename T> std::valarray<T>& elements (Atom& a);
+template <> inline std::valarray<Real>& elements<Real> (Atom& a) { return a.array; }
+template <> inline std::valarray<float>& elements<float> (Atom& a) { return a.array32 (); }
+template <typename T>
+struct ArrayArg { // elements of an ARRAY atom as T, converted if stored otherwise
+	const T* data = nullptr;
+	std::size_t size = 0;
+	std::valarray<T> converted;
+	explicit ArrayArg (const AtomPtr& a) {
+		if (a->type != ARRAY) type_check (a, ARRAY);
+		size = array_size (a);
+		if (!size) return;
+		if (a->f32 == std::is_same<T, float>::value) {
+			data = &elements<T> (*a)[0];
+			return;
+		}
+		converted.resize (size);
+		for (std::size_t i = 0; i < size; ++i) converted[i] = (T) array_value (a, i);
+		data = &converted[0];
+	}
+	ArrayArg (const ArrayArg&) = delete;
+	T operator[] (std::size_t i) const { return data[i]; }
+};
+// f32 arithmetic when f32 arrays only meet f32 arrays or scalars
+inline bool use_f32 (const AtomPtr& n, unsigned from = 0, unsigned to = (unsigned) -1) {
+	bool any = false;
+	for (unsigned i = from; i < n->tail.size () && i < to; ++i) {
+		const AtomPtr& a = n->tail.at (i);
+		if (a->type != ARRAY) return false;
+		if (a->f32) any = true;
+		else if (a->array.size () > 1) return false;
+	}
+	return any;
+}
 std::string next (std::istream &in, unsigned& linenum) {
     std::stringstream accum;
     while (!in.eof ()) {
@@ -268,6 +526,7 @@ AtomPtr read (std::istream& in, unsigned& linenum) {
     if (!token.size()) return nullptr; // EOF sentinel
     if (token == "(") {
         AtomPtr l = make_atom();
+        l->line = linenum + 1;
         l->tail.reserve(8); // OPTIMIZATION: reserve typical list size
         while (true) {
             AtomPtr n = read(in, linenum);
@@ -281,6 +540,7 @@ AtomPtr read (std::istream& in, unsigned& linenum) {
         }
         return l;
     } else if (token == "{") {
+        unsigned line = linenum + 1;
         AtomPtr body = make_atom(); // temporary list of block forms
         body->tail.reserve(8); // OPTIMIZATION
         while (true) {
@@ -295,6 +555,7 @@ AtomPtr read (std::istream& in, unsigned& linenum) {
         }
         if (body->tail.empty()) return make_atom();
         AtomPtr l = make_atom();
+        l->line = line;
         l->tail.reserve(body->tail.size() + 1); // OPTIMIZATION
         l->tail.push_back(make_atom("begin"));
         for (auto& e : body->tail) {
@@ -361,6 +622,13 @@ bool atom_eq (AtomPtr a, AtomPtr b) {
 		break;
 		case ARRAY: { 
             Real eps = 1e-6f;
+            if (a->f32 || b->f32) {
+                if (array_size(a) != array_size(b)) return false;
+                for (std::size_t i = 0; i < array_size(a); ++i) {
+                    if (fabs(array_value(a, i) - array_value(b, i)) >= eps) return false;
+                }
+                return true;
+            }
             return a->array.size() == b->array.size() &&
            ((a->array - b->array).apply(fabs)).max() < eps;
         } break;
@@ -372,26 +640,169 @@ bool atom_eq (AtomPtr a, AtomPtr b) {
 		case OP:
 			return a->op == b->op;
 		break;
+		case DICT:
+			if (a->dict ()->entries.size () != b->dict ()->entries.size ()) return false;
+			for (auto& kv : a->dict ()->index) {
+				auto it = b->dict ()->index.find (kv.first);
+				if (it == b->dict ()->index.end ()) return false;
+				if (!atom_eq (a->dict ()->entries[kv.second].second, b->dict ()->entries[it->second].second)) return false;
+			}
+			return true;
+		break;
+		case REGEX:
+			return a->lexeme == b->lexeme;
+		break;
+		case NATIVE:
+			return a->native () == b->native ();
+		break;
 	}
 	return false; // dummy
 }
 
-AtomPtr assoc (AtomPtr node, AtomPtr env) { // OPTIMIZATION: hash-map based symbol lookup
-	if (!env->cache_valid) { // build cache on first access to this environment
-		env->cache.clear();
-		for (unsigned i = 1; i < env->tail.size (); ++i) {
-			AtomPtr binding = env->tail.at (i);
-			if (!is_nil(binding) && binding->tail.size() >= 2) {
-				AtomPtr sym = binding->tail.at(0);
-				if (sym->type == SYMBOL) {
-					env->cache[sym->lexeme] = binding->tail.at(1);
-				}
+// structural hash, consistent with atom_eq: Reals are hashed on a 1e-6 grid
+// (round (x * 1e6)), so equal values always collide; values within the
+// epsilon of atom_eq that fall in different grid cells may not
+const Real HASH_GRID = 1e6;
+inline std::size_t hash_combine (std::size_t h, std::size_t v) {
+	return h ^ (v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+}
+std::size_t atom_hash (AtomPtr a) {
+	if (is_nil (a)) return 0;
+	std::size_t h = std::hash<int> () (a->type);
+	switch (a->type) {
+		case LIST:
+			for (auto& e : a->tail) h = hash_combine (h, atom_hash (e));
+		break;
+		case SYMBOL: case STRING: case REGEX:
+			h = hash_combine (h, std::hash<std::string> () (a->lexeme));
+		break;
+		case ARRAY:
+			h = hash_combine (h, array_size (a));
+			for (std::size_t i = 0; i < array_size (a); ++i) {
+				h = hash_combine (h, std::hash<Real> () (std::round (array_value (a, i) * HASH_GRID) + 0.0));
 			}
+		break;
+		case LAMBDA: case MACRO:
+			h = hash_combine (h, std::hash<Atom*> () (a->tail.at (0).get ()));
+			h = hash_combine (h, std::hash<Atom*> () (a->tail.at (1).get ()));
+		break;
+		case OP:
+			h = hash_combine (h, std::hash<void*> () ((void*) a->op));
+		break;
+		case NATIVE:
+			h = hash_combine (h, std::hash<void*> () ((void*) a->native ().get ()));
+		break;
+		case DICT: { // order independent
+			std::size_t s = 0;
+			for (auto& kv : a->dict ()->entries) s += hash_combine (atom_hash (kv.first), atom_hash (kv.second));
+			h = hash_combine (h, s);
+		} break;
+	}
+	return h;
+}
+std::size_t atom_bytes (AtomPtr a) { // approximate footprint, shared nodes counted once per use
+	if (!a) return 0;
+	std::size_t b = sizeof (Atom) + a->lexeme.size () + a->array.size () * sizeof (Real)
+		+ (a->extra ? sizeof (AtomExtra) + a->extra->array32.size () * sizeof (float) : 0);
+	if (a->type == LIST) for (auto& e : a->tail) b += sizeof (AtomPtr) + atom_bytes (e);
+	if (a->type == DICT) for (auto& kv : a->dict ()->entries) b += atom_bytes (kv.first) + atom_bytes (kv.second);
+	return b;
+}
+
+// memo tables: LRU of (arguments, result) bounded by a byte budget
+struct MemoTable : Native {
+	struct Entry {
+		AtomPtr args;
+		AtomPtr value;
+		std::size_t hash;
+		std::size_t bytes;
+	};
+	std::mutex lock;
+	std::size_t budget = 0, bytes = 0, hits = 0, misses = 0;
+	std::list<Entry> lru; // most recent first
+	std::unordered_multimap<std::size_t, std::list<Entry>::iterator> index;
+};
+inline std::atomic<std::size_t> g_memo_hits {0}, g_memo_misses {0}, g_memo_evictions {0};
+
+// compiled regular expressions: REGEX atoms hold one, patterns given as
+// strings go through a small LRU cache shared by all threads
+struct Regex : Native {
+	std::regex re;
+	explicit Regex (const std::string& pattern) : re (pattern) {}
+};
+struct RegexCache {
+	static const std::size_t CAPACITY = 64;
+	std::mutex lock;
+	std::list<std::pair<std::string, std::shared_ptr<Regex>>> lru; // most recent first
+	std::unordered_map<std::string, decltype (lru)::iterator> index;
+};
+inline RegexCache g_regex_cache;
+std::shared_ptr<Regex> compile_regex (const std::string& pattern, AtomPtr node) {
+	try {
+		return std::make_shared<Regex> (pattern);
+	} catch (std::regex_error& e) {
+		error (std::string ("[regex] ") + e.what (), node);
+	}
+	return nullptr; // dummy
+}
+std::shared_ptr<Regex> get_regex (AtomPtr pat) { // REGEX atom or pattern string
+	if (pat->type == REGEX) return std::static_pointer_cast<Regex> (pat->native ());
+	const std::string& key = type_check (pat, STRING)->lexeme;
+	RegexCache& c = g_regex_cache;
+	{
+		std::lock_guard<std::mutex> g (c.lock);
+		auto it = c.index.find (key);
+		if (it != c.index.end ()) {
+			c.lru.splice (c.lru.begin (), c.lru, it->second);
+			return it->second->second;
 		}
-		env->cache_valid = true;
-	}	
+	}
+	std::shared_ptr<Regex> r = compile_regex (key, pat); // outside the lock
+	std::lock_guard<std::mutex> g (c.lock);
+	if (c.index.count (key)) return r; // compiled concurrently by another thread
+	c.lru.emplace_front (key, r);
+	c.index[key] = c.lru.begin ();
+	if (c.lru.size () > RegexCache::CAPACITY) {
+		c.index.erase (c.lru.back ().first);
+		c.lru.pop_back ();
+	}
+	return r;
+}
+
+void build_cache (AtomPtr env) {
+	env->cache.clear();
+	for (auto it = env->tail.begin () + 1; it < env->tail.end (); ++it) { // sequential leaf walk
+		const AtomPtr& binding = *it;
+		if (!is_nil(binding) && binding->tail.size() >= 2) {
+			AtomPtr sym = binding->tail.at(0);
+			if (sym->type == SYMBOL) {
+				env->cache[sym->lexeme] = binding->tail.at(1);
+			}
+		}
+	}
+	env->cache_valid = true;
+}
+// the fork (see fork_env) whose code the thread is running: its bindings
+// replace those of its base also for the closures defined in the base, and =
+// on a binding of the base copies it into the fork (see extend)
+inline thread_local const AtomPtr* running_fork = nullptr;
+struct ForkScope { // sets running_fork while code runs in env, if it is a fork
+	AtomPtr env;
+	const AtomPtr* outer = running_fork;
+	explicit ForkScope (AtomPtr e) : env (std::move (e)) { if (env->forked) running_fork = &env; }
+	~ForkScope () { running_fork = outer; }
+	ForkScope (const ForkScope&) = delete;
+};
+AtomPtr assoc (AtomPtr node, AtomPtr env) { // OPTIMIZATION: hash-map based symbol lookup
+	if (!env->cache_valid) build_cache (env); // build cache on first access to this environment
 	auto it = env->cache.find(node->lexeme); 	// O(1) hash map lookup instead of O(n) linear search
 	if (it != env->cache.end()) {
+		if (env->frozen && running_fork && (*running_fork)->tail.at (0) == env) { // base of the running fork
+			const AtomPtr& f = *running_fork;
+			if (!f->cache_valid) build_cache (f);
+			auto w = f->cache.find (node->lexeme);
+			if (w != f->cache.end ()) return w->second;
+		}
 		return it->second;
 	}
 	if (!is_nil (env->tail.at (0))) return assoc (node, env->tail.at (0));
@@ -399,24 +810,116 @@ AtomPtr assoc (AtomPtr node, AtomPtr env) { // OPTIMIZATION: hash-map based symb
 	return make_atom (); // dummy
 }
 
+bool is_bound (AtomPtr node, AtomPtr env) {
+	for (; !is_nil (env); env = env->tail.at (0)) {
+		if (!env->cache_valid) build_cache (env);
+		if (env->cache.count (node->lexeme)) return true;
+	}
+	return false;
+}
+
+// environments visible to the tasks of a running pmap (read-only for them)
+inline thread_local const std::unordered_set<Atom*>* shared_envs = nullptr;
+// constant folding (see fold): code rewritten by load remembers what it was
+// rewritten from, by the names it depends on, until one of them is rebound
+// or a value it inlined is changed in place. Only code loaded in the rebound
+// environment (or below it) is restored: that code belongs to the thread
+// rebinding, code shared with other threads sits in frozen environments
+struct FoldSite {
+	std::weak_ptr<Atom> parent; // list holding the folded value
+	std::size_t index;
+	AtomPtr original, folded;
+	std::weak_ptr<Atom> scope; // environment the code was loaded in
+};
+struct FoldConstant { // value bound by (def name literal)
+	std::weak_ptr<Atom> value, scope;
+	std::string name;
+};
+struct FoldTable {
+	std::mutex lock;
+	std::unordered_map<Atom*, FoldConstant> constants;
+	std::unordered_map<std::string, std::vector<FoldSite> > sites; // by dependency
+	std::atomic<std::uint64_t> names {0}; // bloom filter of the keys of sites
+	std::atomic<bool> enabled {true};
+	std::size_t folded = 0, inlined = 0, restored = 0;
+	static std::uint64_t bit (const std::string& name) { return 1ull << (std::hash<std::string> () (name) & 63); }
+};
+inline FoldTable g_folds;
+ScriptIO::ScriptIO (std::ostream* o, std::ostream* e)
+	: out (o), err (e), precision (g_print_precision), folds (g_folds.enabled) {}
+inline bool folds_enabled () { return script_io ? script_io->folds : g_folds.enabled.load (); }
+void fold_invalidate (const std::string& name, const AtomPtr& env) { // name is rebound in env: restore the code using it
+	std::uint64_t names = g_folds.names.load (std::memory_order_relaxed);
+	if (!names || !(names & FoldTable::bit (name))) return;
+	std::lock_guard<std::mutex> g (g_folds.lock);
+	auto it = g_folds.sites.find (name);
+	if (it == g_folds.sites.end ()) return;
+	std::vector<FoldSite>& v = it->second;
+	v.erase (std::remove_if (v.begin (), v.end (), [&] (const FoldSite& s) {
+		AtomPtr parent = s.parent.lock ();
+		AtomPtr e = s.scope.lock ();
+		if (!parent || !e) return true;
+		while (e != env && !is_nil (e)) e = e->tail.at (0);
+		if (e != env) return false; // loaded elsewhere, does not see this binding
+		if (s.index < parent->tail.size () && parent->tail.at (s.index) == s.folded) {
+			parent->tail.set (s.index, s.original);
+			++g_folds.restored;
+		}
+		return true;
+	}), v.end ());
+	if (v.empty ()) g_folds.sites.erase (it);
+}
+void fold_release (const AtomPtr& value) { // value is changed in place: it is no longer a constant
+	std::string name;
+	AtomPtr scope;
+	{
+		std::lock_guard<std::mutex> g (g_folds.lock);
+		auto it = g_folds.constants.find (value.get ());
+		if (it == g_folds.constants.end ()) return;
+		name = it->second.name;
+		scope = it->second.scope.lock ();
+		if (scope && shared_envs && shared_envs->count (scope.get ())) {
+			error ("[pmap] cannot modify a value of a shared environment from a parallel task", value);
+		}
+		g_folds.constants.erase (it);
+	}
+	value->inlined = false;
+	if (scope) fold_invalidate (name, scope);
+}
 AtomPtr extend (AtomPtr node, AtomPtr val, AtomPtr env, bool recurse = false) {
-	env->cache_valid = false; // OPTIMIZATION: invalidate cache when environment changes
-	for (unsigned i = 1; i < env->tail.size (); ++i) {
-		AtomPtr vv = env->tail.at (i);
+	if (shared_envs && shared_envs->count (env.get ())) {
+		error ("[pmap] cannot modify a shared environment from a parallel task", node);
+	}
+	if (env->frozen) error ("cannot modify a frozen environment (shared by forks)", node);
+	for (auto it = env->tail.begin () + 1; it < env->tail.end (); ++it) {
+		const AtomPtr& vv = *it;
 		if (atom_eq (node, vv->tail.at (0))) {
-			vv->tail.at(1) = val;
+			fold_invalidate (node->lexeme, env);
+			vv->tail.set(1, val);
+			++env->version;
+			if (env->cache_valid && node->type == SYMBOL) env->cache[node->lexeme] = val; // OPTIMIZATION: update, no rebuild
 			return val;
 		}
 	}
 	if (recurse) { // set
-		if (!is_nil (env->tail.at (0))) return extend (node, val, env->tail.at (0), recurse);
+		AtomPtr parent = env->tail.at (0);
+		if (parent->frozen && is_bound (node, parent)) { // copy-on-write
+			if (env->forked) return extend (node, val, env);
+			if (running_fork && (*running_fork)->tail.at (0) == parent) { // by a closure of the base
+				return extend (node, val, *running_fork);
+			}
+		}
+		if (!is_nil (parent)) return extend (node, val, parent, recurse);
 		error ("unbound identifier", node);
 	} else {
+		fold_invalidate (node->lexeme, env);
 		AtomPtr vv = make_atom();
 		vv->tail.reserve(2); // OPTIMIZATION: always 2 elements
 		vv->tail.push_back (node);
 		vv->tail.push_back (val);
 		env->tail.push_back (vv);
+		++env->version;
+		if (env->cache_valid && node->type == SYMBOL) env->cache[node->lexeme] = val;
 		return val;
 	}
 	
@@ -435,8 +938,15 @@ AtomPtr clone_impl(AtomPtr n, std::unordered_map<Atom*, AtomPtr>& seen) {
     r->type    = n->type;
     r->lexeme  = n->lexeme;
     r->array   = n->array;
+    r->f32     = n->f32;
     r->op      = n->op;
     r->minargs = n->minargs;
+    r->line    = n->line;
+    if (n->extra) r->extra = std::make_unique<AtomExtra> (*n->extra);
+    if (n->type == DICT) {
+        r->dict () = std::make_shared<Dict>(*n->dict ());
+        for (auto& e : r->dict ()->entries) e.second = clone_impl(e.second, seen);
+    }
     if (!n->tail.empty()) {
         r->tail.reserve(n->tail.size()); // OPTIMIZATION
         for (auto& t : n->tail) {
@@ -447,18 +957,209 @@ AtomPtr clone_impl(AtomPtr n, std::unordered_map<Atom*, AtomPtr>& seen) {
 }
 AtomPtr clone(AtomPtr n) { 
     if (!n) return nullptr;
-    if (n->tail.empty()) {  // OPTIMIZATION: Fast path for simple atoms without cycles
+    if (n->tail.empty() && n->type != DICT) {  // OPTIMIZATION: Fast path for simple atoms without cycles
         AtomPtr r = make_atom();
         r->type = n->type;
         r->lexeme = n->lexeme;
         r->array = n->array;
+        r->f32 = n->f32;
         r->op = n->op;
         r->minargs = n->minargs;
+        r->line = n->line;
+        if (n->extra) r->extra = std::make_unique<AtomExtra> (*n->extra);
         return r;
     }
     std::unordered_map<Atom*, AtomPtr> seen;
     return clone_impl(n, seen);
 }
+// marks an environment chain, the values bound in it and the scopes of its
+// closures as frozen, with their lookup caches built: threads can then read
+// them without locks, and extend and the in-place primitives refuse to
+// modify them
+void freeze_value (const AtomPtr& v);
+void freeze (AtomPtr env) {
+	for (; !is_nil (env) && !env->frozen; env = env->tail.at (0)) {
+		if (!env->cache_valid) build_cache (env);
+		env->frozen = true;
+		for (auto it = env->tail.begin () + 1; it < env->tail.end (); ++it) {
+			const AtomPtr& b = *it;
+			if (b->frozen) continue; // and so is its value
+			b->frozen = true;
+			freeze_value (b->tail.at (1));
+		}
+	}
+}
+void freeze_value (const AtomPtr& v) {
+	if (!v || v->frozen) return;
+	v->frozen = true;
+	if (v->type == LAMBDA || v->type == MACRO) {
+		freeze_value (v->tail.at (0)); // vars
+		freeze_value (v->tail.at (1)); // body
+		freeze (v->tail.at (2)); // scope
+	} else if (v->type == DICT) {
+		for (auto& kv : v->dict ()->entries) freeze_value (kv.second);
+	} else {
+		for (auto& e : v->tail) freeze_value (e);
+	}
+}
+// O(1) copy of an initialized environment: the fork reads the bindings of base
+// through its parent link, def shadows them and = copies them into the fork on
+// first write, also when done by closures defined in base while the fork runs
+// (see ForkScope). Base is frozen (see freeze): it can no longer be modified,
+// also by in-place primitives (lset, assign, ...) on the values bound in it, so
+// forks can run concurrently on different threads
+AtomPtr fork_env (AtomPtr base) {
+	static std::mutex lock;
+	{
+		std::lock_guard<std::mutex> g (lock);
+		freeze (base);
+	}
+	AtomPtr env = make_atom ();
+	env->tail.push_back (base);
+	env->paths = base->paths;
+	env->forked = true;
+	return env;
+}
+// frozen copy of an environment that keeps changing, for code running on other
+// threads (scheduled events, isolates) in forks of it: frozen environments and
+// values are shared, the rest is copied. The last snapshot taken by a thread
+// is reused while the copied environments (their versions) and all values
+// (g_mutations) are unchanged, so repeated calls cost a few comparisons. When
+// only bindings changed, the next snapshot still reuses the binding pairs of
+// the last one whose values are the same and do not reach a copied
+// environment, and the copies of the code of its functions: only closures
+// over the copied environments and the changed bindings are copied again
+struct SnapshotCopier {
+	struct Copy { // value: of a source binding when copied; used: by the snapshot of that number
+		AtomPtr source, value, copy;
+		std::size_t used;
+	};
+	typedef std::unordered_map<Atom*, Copy> Copies;
+	std::unordered_map<Atom*, AtomPtr> seen;
+	std::vector<std::pair<AtomPtr, std::uint32_t> > envs; // copied, with their versions
+	Copies copies; // of the last snapshots, updated for the next one
+	std::size_t number = 0, used = 0; // of this snapshot, copies it uses
+	bool reached = false; // the value being copied reaches a copied environment
+	AtomPtr env (AtomPtr e) {
+		if (is_nil (e) || e->frozen) return e;
+		reached = true;
+		auto it = seen.find (e.get ());
+		if (it != seen.end ()) return it->second;
+		envs.emplace_back (e, e->version);
+		AtomPtr r = make_atom ();
+		seen[e.get ()] = r;
+		r->paths = e->paths;
+		r->forked = e->forked;
+		std::vector<AtomPtr> tail;
+		tail.reserve (e->tail.size ());
+		tail.push_back (env (e->tail.at (0)));
+		for (auto b = e->tail.begin () + 1; b < e->tail.end (); ++b) {
+			tail.push_back (binding (*b));
+			const AtomPtr& sym = tail.back ()->tail.at (0);
+			if (sym->type == SYMBOL) r->cache[sym->lexeme] = tail.back ()->tail.at (1); // as build_cache
+		}
+		r->tail = std::move (tail);
+		r->cache_valid = true;
+		return r;
+	}
+	AtomPtr binding (const AtomPtr& b) {
+		const AtomPtr& v = b->tail.at (1);
+		auto it = copies.find (b.get ());
+		if (it != copies.end () && it->second.source == b && it->second.value == v) {
+			const AtomPtr& copy = it->second.copy->tail.at (1);
+			if ((v->type != LIST && v->type != DICT) || seen.emplace (v.get (), copy).first->second == copy) {
+				return use (it->second).copy; // lists and dicts keep one copy
+			}
+		}
+		bool outer = reached;
+		reached = false;
+		AtomPtr r = make_atom ();
+		r->tail.push_back (b->tail.at (0));
+		r->tail.push_back (value (v));
+		if (!reached) use (copies[b.get ()] = Copy {b, v, r, 0});
+		reached = reached || outer;
+		return r;
+	}
+	AtomPtr code (const AtomPtr& c) { // vars and bodies of functions
+		auto it = copies.find (c.get ());
+		if (it != copies.end () && it->second.source == c) return use (it->second).copy;
+		return use (copies[c.get ()] = Copy {c, nullptr, clone (c), 0}).copy;
+	}
+	Copy& use (Copy& c) {
+		if (c.used != number) ++used;
+		c.used = number;
+		return c;
+	}
+	void prune () { // drops the copies no longer used, when they are most
+		if (copies.size () <= 2 * used) return;
+		for (auto it = copies.begin (); it != copies.end ();) {
+			if (it->second.used != number) it = copies.erase (it);
+			else ++it;
+		}
+	}
+	AtomPtr value (AtomPtr v) {
+		if (!v || v->frozen) return v;
+		auto it = seen.find (v.get ());
+		if (it != seen.end ()) return it->second;
+		if (v->type != LAMBDA && v->type != MACRO && v->type != LIST && v->type != DICT) return clone (v);
+		AtomPtr r = make_atom ();
+		seen[v.get ()] = r;
+		r->type = v->type;
+		r->line = v->line;
+		if (v->type == LAMBDA || v->type == MACRO) {
+			r->tail.push_back (code (v->tail.at (0))); // vars
+			r->tail.push_back (code (v->tail.at (1))); // body
+			r->tail.push_back (env (v->tail.at (2))); // scope
+		} else if (v->type == DICT) {
+			r->dict () = std::make_shared<Dict> (*v->dict ());
+			for (auto& kv : r->dict ()->entries) kv.second = value (kv.second);
+		} else {
+			r->tail.reserve (v->tail.size ());
+			for (auto& e : v->tail) r->tail.push_back (value (e));
+		}
+		return r;
+	}
+};
+AtomPtr snapshot_env (AtomPtr env) {
+	struct Snapshot {
+		AtomPtr source, copy;
+		std::vector<std::pair<AtomPtr, std::uint32_t> > envs;
+		std::size_t mutations = 0, restored = 0, number = 0;
+		SnapshotCopier::Copies copies;
+	};
+	static thread_local Snapshot last;
+	if (env->frozen) return env;
+	std::size_t mutations = g_mutations.load ();
+	if (last.source == env && last.mutations == mutations
+		&& std::all_of (last.envs.begin (), last.envs.end (),
+			[] (const std::pair<AtomPtr, std::uint32_t>& e) { return e.first->version == e.second; })) {
+		return last.copy;
+	}
+	std::size_t restored;
+	{
+		std::lock_guard<std::mutex> g (g_folds.lock);
+		restored = g_folds.restored;
+	}
+	SnapshotCopier c;
+	if (last.source == env && last.mutations == mutations && last.restored == restored) {
+		c.copies = std::move (last.copies); // values and code are as they were copied
+	}
+	c.number = last.number + 1;
+	AtomPtr copy = c.env (env);
+	freeze (copy);
+	c.prune ();
+	last = Snapshot {env, copy, std::move (c.envs), mutations, restored, c.number, std::move (c.copies)};
+	return copy;
+}
+// a copy of a function whose scope is a fork of a snapshot of its scope
+AtomPtr detach_function (AtomPtr f) {
+	AtomPtr r = make_atom ();
+	r->type = f->type;
+	r->tail.push_back (clone (f->tail.at (0))); // vars
+	r->tail.push_back (clone (f->tail.at (1))); // body
+	r->tail.push_back (fork_env (snapshot_env (f->tail.at (2))));
+	return r;
+}
 struct BreakException : public std::exception {
     const char* what() const noexcept override { return "unhandled break"; }
 };
@@ -473,10 +1174,177 @@ AtomPtr fn_while (AtomPtr, AtomPtr) { return nullptr; } // dummy
 AtomPtr fn_begin (AtomPtr, AtomPtr) { return nullptr; } // dummy
 AtomPtr fn_apply (AtomPtr, AtomPtr) { return nullptr; } // dummy
 AtomPtr fn_eval (AtomPtr, AtomPtr) { return nullptr; } // dummy
+AtomPtr fn_bench (AtomPtr node, AtomPtr env); // special form, gets the unevaluated node
+AtomPtr make_frame (AtomPtr func, AtomPtr args, AtomPtr node) { // binds args to a new frame
+	AtomPtr vars = func->tail.at(0);
+	AtomPtr body = func->tail.at(1);
+	AtomPtr nenv = make_atom();
+	nenv->tail.reserve(1 + vars->tail.size()); // OPTIMIZATION
+	nenv->tail.push_back(func->tail.at(2)); // parent env (lexical)
+	if (vars->tail.size() < args->tail.size())
+		error("[lambda/macro] too many arguments", node);
+	unsigned minargs = (vars->tail.size() > args->tail.size()
+						? args->tail.size()
+						: vars->tail.size());
+	for (unsigned i = 0; i < minargs; ++i) { // fresh frame: nothing to check or invalidate, see extend
+		AtomPtr vv = make_atom();
+		vv->tail.reserve(2);
+		vv->tail.push_back(vars->tail.at(i));
+		vv->tail.push_back(args->tail.at(i));
+		nenv->tail.push_back(vv);
+	}
+	// Currying / partial application
+	if (vars->tail.size() > args->tail.size()) {
+		AtomPtr vars_rest = make_atom();
+		vars_rest->tail.reserve(vars->tail.size() - minargs); // OPTIMIZATION
+		for (unsigned i = minargs; i < vars->tail.size(); ++i) {
+			vars_rest->tail.push_back(vars->tail.at(i));
+		}
+		AtomPtr new_lambda = make_atom();
+		new_lambda->tail.reserve(3); // OPTIMIZATION
+		new_lambda->tail.push_back(vars_rest);
+		new_lambda->tail.push_back(body);
+		new_lambda->tail.push_back(nenv);
+		AtomPtr f = make_atom(new_lambda);
+		if (func->type == MACRO) f->type = MACRO;
+		return f;
+	}
+	return nenv;
+}
+// profiling: the thread running (profile ...) charges pending timer ticks
+// to the closures being called, named by their def (or else by the call)
+// and the source line of their lambda; special forms are not frames and
+// primitives are leaves
+inline thread_local Profiler* active_profiler = nullptr;
+struct ProfileFrame {
+	std::size_t depth; // eval_stack entry making the call, replaced on tail calls
+	AtomPtr caller;
+	AtomPtr func;
+	bool named_by_call;
+};
+inline thread_local std::vector<ProfileFrame> profile_frames;
+void profile_call (const AtomPtr& func, bool named_by_call) { // func is called by eval_stack.back ()
+	std::size_t d = eval_stack.size ();
+	while (profile_frames.size () && profile_frames.back ().depth >= d) profile_frames.pop_back ();
+	profile_frames.push_back ({d, eval_stack.back (), func, named_by_call});
+}
+std::string profile_name (const ProfileFrame& f) {
+	std::string name = f.func->lexeme;
+	if (name.empty ()) {
+		const AtomPtr& h = f.caller->tail.size () ? f.caller->tail.at (0) : f.caller;
+		name = f.named_by_call && h->type == SYMBOL ? h->lexeme : "(lambda)";
+	}
+	if (f.func->line) name += ":" + std::to_string (f.func->line);
+	return name;
+}
+void profile_sample (const AtomPtr& op = nullptr) {
+	std::size_t n = active_profiler->take ();
+	if (!n) return;
+	std::string stack;
+	for (auto& f : profile_frames) {
+		if (f.depth > eval_stack.size () || eval_stack[f.depth - 1] != f.caller) continue; // returned
+		if (stack.size ()) stack += ';';
+		stack += profile_name (f);
+	}
+	if (op) { // time spent in a primitive
+		if (stack.size ()) stack += ';';
+		stack += "[" + op->lexeme + "]";
+	}
+	active_profiler->add (stack.size () ? stack : "(top)", n);
+}
+// instrumentation: ops registered by add_op carry their (info stats) counters
+struct OpSlot : Native {
+	std::shared_ptr<OpCounters> counters;
+};
+AtomPtr call_op (const AtomPtr& func, AtomPtr args, AtomPtr env) {
+	OpSlot* s = OpStats::instance ().enabled () && func->extra ? dynamic_cast<OpSlot*> (func->extra->native.get ()) : nullptr;
+	if (!s) return func->op (args, env);
+	std::size_t elems = 0, largest = 0;
+	for (auto& a : args->tail) {
+		if (a->type != ARRAY) continue;
+		std::size_t n = array_size (a);
+		elems += n;
+		if (n > largest) largest = n;
+	}
+	struct Timer { // records failed calls too
+		OpCounters& c;
+		std::size_t elems, largest;
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now ();
+		~Timer () {
+			c.add (std::chrono::duration_cast<std::chrono::nanoseconds> (
+				std::chrono::steady_clock::now () - t0).count (), elems, largest);
+		}
+	} t {*s->counters, elems, largest};
+	return func->op (args, env);
+}
+struct MemoryReport {
+	std::size_t types[NATIVE + 1] = {}, atoms = 0, envs = 0, array_bytes = 0, tail_slots = 0;
+};
+MemoryReport memory_report (AtomPtr env) { // atoms reachable from env and its parents
+	MemoryReport r;
+	std::unordered_set<Atom*> seen, envs;
+	std::vector<std::pair<Atom*, bool> > todo {{env.get (), true}}; // (atom, used as an environment)
+	while (todo.size ()) {
+		Atom* a = todo.back ().first;
+		bool is_env = todo.back ().second;
+		todo.pop_back ();
+		if (is_env && a->tail.size () && envs.insert (a).second) {
+			todo.push_back ({a->tail.at (0).get (), true}); // parent
+		}
+		if (!seen.insert (a).second) continue;
+		++r.atoms;
+		++r.types[a->type];
+		r.array_bytes += a->array.size () * sizeof (Real) + (a->extra ? a->extra->array32.size () * sizeof (float) : 0);
+		r.tail_slots += a->tail.capacity ();
+		unsigned i = 0;
+		for (auto& e : a->tail) {
+			bool closure_env = (a->type == LAMBDA || a->type == MACRO) && i++ == 2;
+			if (e) todo.push_back ({e.get (), closure_env});
+		}
+		if (a->type == DICT) {
+			for (auto& e : a->dict ()->entries) {
+				todo.push_back ({e.first.get (), false});
+				todo.push_back ({e.second.get (), false});
+			}
+		}
+	}
+	r.envs = envs.size ();
+	return r;
+}
+// periodic dump of the report to stderr, requested by a scheduler event and
+// written by the next thread going through eval
+inline std::atomic<bool> g_memory_dump_due {false};
+inline std::atomic<unsigned> g_memory_dump_gen {0};
+inline std::atomic<std::uint64_t> g_memory_dump_event {0};
+void memory_dump (AtomPtr env) {
+	MemoryReport r = memory_report (env);
+	std::cerr << "[memory] live " << g_live_atoms.load () << " reachable " << r.atoms
+		<< " envs " << r.envs << " array-bytes " << r.array_bytes << " tail-slots " << r.tail_slots;
+	for (unsigned t = 0; t <= NATIVE; ++t) std::cerr << " " << ATOM_NAMES[t] << " " << r.types[t];
+	for (unsigned t = 0; t <= NATIVE; ++t) std::cerr << " live-" << ATOM_NAMES[t] << " " << g_live_types[t].load ();
+	std::cerr << std::endl;
+}
+void schedule_memory_dump (double secs, unsigned gen) {
+	Scheduler::Clock::time_point due = Scheduler::Clock::now ()
+		+ std::chrono::duration_cast<Scheduler::Clock::duration> (std::chrono::duration<double> (secs));
+	g_memory_dump_event = Scheduler::instance ().post (due, [secs, gen] () {
+		if (gen != g_memory_dump_gen) return; // stopped or restarted
+		g_memory_dump_due = true;
+		schedule_memory_dump (secs, gen);
+	});
+}
+// set on threads that can be asked to stop (isolates, see ~Isolate)
+inline thread_local const std::atomic<bool>* g_cancel = nullptr;
+inline void check_cancel () {
+	if (g_cancel && g_cancel->load (std::memory_order_relaxed)) throw std::runtime_error ("cancelled");
+}
 AtomPtr eval (AtomPtr node, AtomPtr env) {
 	StackGuard guard(node); 
 	while (true) {
 		call_yield ();
+		check_cancel ();
+		if (active_profiler && active_profiler->due ()) profile_sample ();
+		if (g_memory_dump_due.load (std::memory_order_relaxed) && g_memory_dump_due.exchange (false)) memory_dump (env);
 		if (is_nil (node)) return make_atom ();
 		if (node->type == SYMBOL && node->lexeme.size ()) return assoc (node, env);
 		if (node->type != LIST) return node;
@@ -492,11 +1360,17 @@ AtomPtr eval (AtomPtr node, AtomPtr env) {
 		}
 		if (func->op == &fn_def) {
 			args_check (node, 3);
-			return extend (type_check (node->tail.at (1), SYMBOL), eval (node->tail.at (2), env), env);
+			type_check (node->tail.at (1), SYMBOL);
+			AtomPtr v = eval (node->tail.at (2), env);
+			const AtomPtr& form = node->tail.at (2);
+			if (v->type == LAMBDA && form->type == LIST && form->tail.size () && form->tail.at (0)->type == SYMBOL
+				&& form->tail.at (0)->lexeme == "lambda") v->lexeme = node->tail.at (1)->lexeme; // fresh closure: name it
+			return extend (node->tail.at (1), v, env);
 		}
 		if (func->op == &fn_set) {
 			args_check (node, 3);
-			return extend (type_check (node->tail.at (1), SYMBOL), eval (node->tail.at (2), env), env, true);
+			type_check (node->tail.at (1), SYMBOL);
+			return extend (node->tail.at (1), eval (node->tail.at (2), env), env, true);
 		}
 		if (func->op == &fn_lambda || func->op == &fn_macro) {
 			args_check (node, 3);
@@ -511,12 +1385,13 @@ AtomPtr eval (AtomPtr node, AtomPtr env) {
 			ll->tail.push_back (body); // body
 			ll->tail.push_back (env); // env (lexical scope)
 			AtomPtr f = make_atom(ll); // lambda
+			f->line = node->line ? node->line : node->tail.at (2)->line; // for the profiler
 			if (func->op == &fn_macro) f->type = MACRO;
 			return f;
 		}
 		if (func->op == &fn_if) {
 			args_check (node, 3);
-			if (type_check (eval (node->tail.at (1), env), ARRAY)->array[0]) {
+			if (scalar_check (eval (node->tail.at (1), env))) {
 				node = node->tail.at (2);
 				continue; 
 			} else {
@@ -529,7 +1404,7 @@ AtomPtr eval (AtomPtr node, AtomPtr env) {
 		if (func->op == &fn_while) {
 			args_check(node, 3);
 			AtomPtr r = make_atom();
-			while (type_check(eval(node->tail.at(1), env), ARRAY)->array[0]) {
+			while (scalar_check(eval(node->tail.at(1), env))) {
 				call_yield ();
 				try {
 					r = eval(node->tail.at(2), env);
@@ -539,6 +1414,9 @@ AtomPtr eval (AtomPtr node, AtomPtr env) {
 			}
 			return r;
 		}
+		if (func->op == &fn_bench) {
+			return fn_bench (node, env);
+		}
 		if (func->op == &fn_begin) {
 			args_check (node, 2);
 			for (unsigned i = 0; i < node->tail.size () - 1; ++i) {
@@ -553,36 +1431,14 @@ AtomPtr eval (AtomPtr node, AtomPtr env) {
 			args->tail.push_back ((func->type == MACRO ? node->tail.at (i) : eval (node->tail.at (i), env)));
 		}
 		if (func->type == LAMBDA || func->type == MACRO) {
-			AtomPtr vars = func->tail.at(0);
 			AtomPtr body = func->tail.at(1);
-			AtomPtr nenv = make_atom();
-			nenv->tail.reserve(1 + vars->tail.size()); // OPTIMIZATION
-			nenv->tail.push_back(func->tail.at(2)); // parent env (lexical)
-			if (vars->tail.size() < args->tail.size())
-				error("[lambda/macro] too many arguments", node);
-			unsigned minargs = (vars->tail.size() > args->tail.size()
-								? args->tail.size()
-								: vars->tail.size());
-			for (unsigned i = 0; i < minargs; ++i) {
-				extend(vars->tail.at(i), args->tail.at(i), nenv);
-			}
-			// Currying / partial application
-			if (vars->tail.size() > args->tail.size()) {
-				AtomPtr vars_rest = make_atom();
-				vars_rest->tail.reserve(vars->tail.size() - minargs); // OPTIMIZATION
-				for (unsigned i = minargs; i < vars->tail.size(); ++i) {
-					vars_rest->tail.push_back(vars->tail.at(i));
-				}
-				AtomPtr new_lambda = make_atom();
-				new_lambda->tail.reserve(3); // OPTIMIZATION
-				new_lambda->tail.push_back(vars_rest);
-				new_lambda->tail.push_back(body);
-				new_lambda->tail.push_back(nenv);
-				AtomPtr f = make_atom(new_lambda);
-				if (func->type == MACRO) f->type = MACRO;
-				return f;
-			}
+			AtomPtr nenv = make_frame (func, args, node);
+			if (nenv->type != LIST) return nenv; // partial application
 			if (func->type == LAMBDA) {
+				if (active_profiler) {
+					eval_stack.back () = node; // tail call: profile the callee
+					profile_call (func, true);
+				}
 				env = nenv;
 				for (unsigned i = 0; i < body->tail.size() - 1; ++i) {
 					eval(body->tail.at(i), nenv);
@@ -610,13 +1466,20 @@ AtomPtr eval (AtomPtr node, AtomPtr env) {
 				continue; 
 			}	
 			if (func->op == &fn_apply) {
-				AtomPtr l = type_check (args->tail.at (1), LIST);
-				l->tail.insert (l->tail.begin(), args->tail.at(0));
-
+				AtomPtr src = type_check (args->tail.at (1), LIST);
+				AtomPtr l = make_atom (); // the argument list may be shared
+				l->tail.reserve (src->tail.size () + 1);
+				l->tail.push_back (args->tail.at (0));
+				l->tail.append (src->tail);
 				node = l;
 				continue; 
 			}			
-			return func->op (args, env);
+			if (active_profiler) {
+				AtomPtr r = call_op (func, args, env);
+				if (active_profiler->due ()) profile_sample (func);
+				return r;
+			}
+			return call_op (func, args, env);
 		}	
 		error ("function expected", node);
 	}
@@ -634,19 +1497,15 @@ void browse_env(AtomPtr env, AtomPtr vars) {
         browse_env(env->tail.at(0), vars);
     }
 }
+void dict_set (AtomPtr d, AtomPtr k, AtomPtr v, AtomPtr node);
 AtomPtr fn_info(AtomPtr b, AtomPtr env) {
-    std::string cmd = type_check(b->tail.at(0), SYMBOL)->lexeme;
+    AtomPtr c = b->tail.at(0); // (info 'threads) or (info threads)
+    std::string cmd = (c->type == OP ? c : type_check(c, SYMBOL))->lexeme;
     AtomPtr l = make_atom();
-    std::regex r;
     if (cmd == "vars") {
-        // (info vars) or (info vars "regex")
-        std::string pattern = ".*";
-        if (b->tail.size() > 1) {
-            // second arg should be a STRING with the regex pattern
-            AtomPtr pat = type_check(b->tail.at(1), STRING);
-            pattern = pat->lexeme;
-        }
-        r.assign(pattern);
+        // (info vars) or (info vars "regex") or (info vars (regex "..."))
+        std::shared_ptr<Regex> rx = get_regex(b->tail.size() > 1 ? b->tail.at(1) : make_atom(std::string("\".*")));
+        const std::regex& r = rx->re;
         AtomPtr vars = make_atom();
         browse_env(env, vars);
         l->tail.reserve(vars->tail.size()); // OPTIMIZATION
@@ -677,35 +1536,314 @@ AtomPtr fn_info(AtomPtr b, AtomPtr env) {
             AtomPtr v = b->tail.at(i);
             l->tail.push_back(make_atom(std::string(ATOM_NAMES[v->type])));
         }
+    } else if (cmd == "threads") {
+        // (info threads) -> [threads threshold]
+        return make_atom(std::valarray<Real>({(Real) parallel_threads(), (Real) g_parallel_threshold}));
+    } else if (cmd == "memo") {
+        // (info memo) -> [hits misses evictions], (info memo f) -> [hits misses entries bytes]
+        if (b->tail.size() > 1) {
+            AtomPtr f = type_check(b->tail.at(1), LAMBDA);
+            AtomPtr call = f->tail.at(1)->tail.size() ? f->tail.at(1)->tail.at(0) : nullptr;
+            MemoTable* t = call && call->type == LIST && call->tail.size() > 1
+                && call->tail.at(1)->extra ? dynamic_cast<MemoTable*>(call->tail.at(1)->extra->native.get()) : nullptr;
+            if (!t) error("[info] memoized function expected", f);
+            std::lock_guard<std::mutex> g(t->lock);
+            return make_atom(std::valarray<Real>({(Real) t->hits, (Real) t->misses,
+                (Real) t->lru.size(), (Real) t->bytes}));
+        }
+        return make_atom(std::valarray<Real>({(Real) g_memo_hits, (Real) g_memo_misses, (Real) g_memo_evictions}));
+    } else if (cmd == "scheduler") {
+        // (info scheduler) -> [fired pending cancelled jitter-mean jitter-max jitter-stddev], jitter in us
+        Scheduler::Stats s = Scheduler::instance().stats();
+        if (b->tail.size() > 1) Scheduler::instance().reset_stats(); // (info scheduler reset)
+        return make_atom(std::valarray<Real>({(Real) s.fired, (Real) s.pending, (Real) s.cancelled,
+            s.mean_us, s.max_us, s.stddev_us}));
+    } else if (cmd == "folds") {
+        // (info folds [on|off]) -> [folded inlined restored]: calls and symbols replaced by load, and restored;
+        // on|off applies to the running script only when the host gives it its own settings (see ScriptIO)
+        if (b->tail.size() > 1) {
+            std::string sub = type_check(b->tail.at(1), SYMBOL)->lexeme;
+            if (sub != "on" && sub != "off") error("[info] invalid folds request", b->tail.at(1));
+            if (script_io) script_io->folds = sub == "on";
+            else g_folds.enabled = sub == "on";
+            return make_atom((Real) folds_enabled());
+        }
+        std::lock_guard<std::mutex> g(g_folds.lock);
+        return make_atom(std::valarray<Real>({(Real) g_folds.folded, (Real) g_folds.inlined, (Real) g_folds.restored}));
+    } else if (cmd == "stats") {
+        // (info stats [on|off|reset]) -> ((op [calls time-us elements elements-per-s] [sizes...]) ...)
+        // sizes[b] counts calls whose largest array argument has 2^(b-1) to 2^b - 1 elements
+        if (b->tail.size() > 1) {
+            std::string sub = type_check(b->tail.at(1), SYMBOL)->lexeme;
+            if (sub == "on") OpStats::instance().enable(true);
+            else if (sub == "off") OpStats::instance().enable(false);
+            else if (sub == "reset") OpStats::instance().reset();
+            else error("[info] invalid stats request", b->tail.at(1));
+            return make_atom(OpStats::instance().enabled() ? (Real) 1 : (Real) 0);
+        }
+        std::vector<std::pair<Real, AtomPtr>> rows;
+        OpStats::instance().for_each([&rows](const std::string& name, const OpCounters& c) {
+            Real calls = c.calls, us = c.ns / 1e3, elems = c.elements;
+            if (!calls) return;
+            unsigned n = OpCounters::BUCKETS;
+            while (n > 1 && !c.sizes[n - 1]) --n;
+            std::valarray<Real> sizes(n);
+            for (unsigned i = 0; i < n; ++i) sizes[i] = c.sizes[i];
+            AtomPtr row = make_atom();
+            row->tail.push_back(make_atom(name));
+            row->tail.push_back(make_atom(std::valarray<Real>({calls, us, elems, us > 0 ? elems * 1e6 / us : 0})));
+            row->tail.push_back(make_atom(std::move(sizes)));
+            rows.push_back({us, row});
+        });
+        std::stable_sort(rows.begin(), rows.end(), [](const auto& x, const auto& y) { return x.first > y.first; });
+        l->tail.reserve(rows.size()); // OPTIMIZATION
+        for (auto& r : rows) l->tail.push_back(r.second);
+    } else if (cmd == "memory") {
+        // (info memory) -> dict of atoms reachable from env (total, by type, envs, array bytes, tail slots)
+        // and live atoms (total, live-<type>), counted between (info memory on) and (info memory off)
+        // until destroyed;
+        // (info memory every secs) dumps the same figures on stderr every secs, 0 stops
+        if (b->tail.size() > 1) {
+            std::string sub = type_check(b->tail.at(1), SYMBOL)->lexeme;
+            if (sub == "on" || sub == "off") {
+                g_count_atoms = sub == "on";
+                return make_atom((Real) g_count_atoms.load());
+            }
+            if (sub != "every" || b->tail.size() < 3) error("[info] invalid memory request", b->tail.at(1));
+            Real secs = scalar_check(b->tail.at(2));
+            if (secs < 0) error("[info] invalid dump interval", b->tail.at(2));
+            unsigned gen = ++g_memory_dump_gen;
+            Scheduler::instance().cancel(g_memory_dump_event);
+            if (secs > 0) schedule_memory_dump(secs, gen);
+            return make_atom(secs);
+        }
+        MemoryReport r = memory_report(env);
+        AtomPtr d = make_atom();
+        d->type = DICT;
+        d->dict () = std::make_shared<Dict>();
+        auto put = [&d](const char* k, Real v) { dict_set(d, make_atom(std::string(k)), make_atom(v), d); };
+        put("live", g_live_atoms.load());
+        put("reachable", r.atoms);
+        put("envs", r.envs);
+        put("array-bytes", r.array_bytes);
+        put("tail-slots", r.tail_slots);
+        for (unsigned t = 0; t <= NATIVE; ++t) put(ATOM_NAMES[t], r.types[t]);
+        for (unsigned t = 0; t <= NATIVE; ++t) put(("live-" + std::string(ATOM_NAMES[t])).c_str(), g_live_types[t].load());
+        return d;
     } else {
         error("[info] invalid request", b->tail.at(0));
     }
     return l;
 }
+AtomPtr fn_threads (AtomPtr node, AtomPtr env) {
+	if (node->tail.size () > 0) {
+		int n = (int) scalar_check (node->tail.at (0));
+		if (n < 1) error ("[threads] invalid number of threads", node);
+		if ((std::size_t) n != parallel_threads ()) ThreadPool::instance ().resize (n);
+	}
+	if (node->tail.size () > 1) {
+		Real t = scalar_check (node->tail.at (1));
+		if (t < 1) error ("[threads] invalid threshold", node);
+		g_parallel_threshold = (std::size_t) t;
+	}
+	return make_atom (std::valarray<Real>({(Real) parallel_threads (), (Real) g_parallel_threshold}));
+}
+AtomPtr apply_function (AtomPtr func, AtomPtr args, AtomPtr env);
+void write_profile (Profiler& p, const std::string& fname, std::ostream& summary) {
+	std::ofstream out (fname);
+	if (!out.good ()) error ("[profile] cannot write on", make_string (fname));
+	p.write_folded (out);
+	p.write_summary (summary);
+	summary << "folded stacks written to " << fname << std::endl;
+}
+AtomPtr fn_profile (AtomPtr node, AtomPtr env) { // (%profile thunk [folded-file]) -> value of thunk
+	AtomPtr f = type_check (node->tail.at (0), LAMBDA);
+	std::string fname = node->tail.size () > 1 ? type_check (node->tail.at (1), STRING)->lexeme : "musil.folded";
+	if (active_profiler) error ("[profile] already profiling", node);
+	Profiler p;
+	active_profiler = &p;
+	p.start ();
+	AtomPtr r;
+	try {
+		r = apply_function (f, make_atom (), env);
+	} catch (...) {
+		p.stop ();
+		active_profiler = nullptr;
+		profile_frames.clear ();
+		throw;
+	}
+	p.stop ();
+	active_profiler = nullptr;
+	profile_frames.clear ();
+	write_profile (p, fname, output ());
+	return r;
+}
+// (bench expr [iterations] [warmup]) -> ([median mean stddev min max ops/s atoms] [times...])
+// times in usec, one per iteration; atoms allocated by one more, untimed run
+AtomPtr fn_bench (AtomPtr node, AtomPtr env) {
+	args_check (node, 2);
+	AtomPtr expr = node->tail.at (1);
+	long iterations = node->tail.size () > 2 ? (long) scalar_check (eval (node->tail.at (2), env)) : 100;
+	long warmup = node->tail.size () > 3 ? (long) scalar_check (eval (node->tail.at (3), env)) : iterations / 10;
+	if (iterations < 1 || warmup < 0) error ("[bench] invalid number of iterations", node);
+	for (long i = 0; i < warmup; ++i) eval (expr, env);
+	std::valarray<Real> times (iterations);
+	for (long i = 0; i < iterations; ++i) {
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now ();
+		eval (expr, env);
+		times[i] = std::chrono::duration<Real, std::micro> (std::chrono::steady_clock::now () - t0).count ();
+	}
+	std::valarray<Real> sorted (times);
+	std::sort (std::begin (sorted), std::end (sorted));
+	std::size_t n = sorted.size ();
+	Real median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+	Real mean = times.sum () / n;
+	Real stddev = std::sqrt (((times - mean) * (times - mean)).sum () / n);
+	bool counting = g_count_atoms.exchange (true);
+	std::size_t made = g_made_atoms;
+	eval (expr, env);
+	Real atoms = g_made_atoms - made;
+	g_count_atoms = counting;
+	AtomPtr r = make_atom ();
+	r->tail.push_back (make_atom (std::valarray<Real> ({median, mean, stddev, sorted[0], sorted[n - 1],
+		mean > 0 ? 1e6 / mean : 0, atoms})));
+	r->tail.push_back (make_atom (std::move (times)));
+	return r;
+}
+AtomPtr apply_function (AtomPtr func, AtomPtr args, AtomPtr env) { // calls func on evaluated args
+	if (func->type == LAMBDA) {
+		AtomPtr nenv = make_frame (func, args, args);
+		if (nenv->type != LIST) return nenv; // partial application
+		if (active_profiler && eval_stack.size ()) profile_call (func, false);
+		AtomPtr r = make_atom ();
+		for (auto& e : func->tail.at (1)->tail) r = eval (e, nenv);
+		return r;
+	}
+	if (func->type != OP || func->minargs == (unsigned) -1) error ("function expected", func);
+	args_check (args, func->minargs);
+	if (func->op == &fn_eval) return eval (args->tail.at (0), env);
+	if (func->op == &fn_apply) {
+		AtomPtr call = make_atom ();
+		call->tail.push_back (args->tail.at (0));
+		AtomPtr l = type_check (args->tail.at (1), LIST);
+		call->tail.append (l->tail);
+		return eval (call, env);
+	}
+	return call_op (func, args, env);
+}
+void share_envs (AtomPtr env, std::unordered_set<Atom*>& shared) { // frames read by parallel tasks
+	while (!is_nil (env) && shared.insert (env.get ()).second) {
+		if (!env->cache_valid) build_cache (env); // tasks only read it
+		for (unsigned i = 1; i < env->tail.size (); ++i) {
+			AtomPtr v = env->tail.at (i)->tail.at (1);
+			if (v->type == LAMBDA || v->type == MACRO) share_envs (v->tail.at (2), shared);
+		}
+		env = env->tail.at (0);
+	}
+}
+// values bound in the frames read by parallel tasks, and the list they map;
+// collected when a task first changes a value in place (see mutable_check).
+// Each task may still change its own element of the list
+struct SharedValues {
+	const std::unordered_set<Atom*>& envs;
+	AtomPtr list;
+	SharedValues* outer; // of the pmap running the task that started this one
+	std::once_flag once;
+	std::unordered_set<const Atom*> values;
+	SharedValues (const std::unordered_set<Atom*>& e, AtomPtr l) : envs (e), list (l), outer (shared_values) {}
+	void add (const AtomPtr& v) {
+		if (v->type == LAMBDA || v->type == MACRO || v->type == OP || !values.insert (v.get ()).second) return;
+		if (v->type == DICT) for (auto& kv : v->dict ()->entries) add (kv.second);
+		else for (auto& e : v->tail) add (e);
+	}
+	bool contains (const Atom* v) {
+		std::call_once (once, [this] () {
+			for (Atom* env : envs) {
+				for (unsigned i = 1; i < env->tail.size (); ++i) add (env->tail.at (i)->tail.at (1));
+			}
+			for (auto& e : list->tail) values.erase (e.get ());
+			values.insert (list.get ());
+		});
+		return values.count (v) || (outer && outer->contains (v));
+	}
+};
+bool is_shared_value (const Atom* v) { return shared_values->contains (v); }
+AtomPtr parallel_apply (AtomPtr node, AtomPtr env, bool collect) {
+	AtomPtr func = node->tail.at (0);
+	AtomPtr l = type_check (node->tail.at (1), LIST);
+	std::size_t n = l->tail.size ();
+	std::unordered_set<Atom*> shared;
+	share_envs (env, shared);
+	if (func->type == LAMBDA) share_envs (func->tail.at (2), shared);
+	if (running_fork) share_envs (*running_fork, shared); // tasks read it through the closures of its base
+	SharedValues values (shared, l);
+	std::vector<AtomPtr> results (n);
+	std::vector<std::string> errors (n);
+	std::size_t chunks = std::min (n, 4 * parallel_threads ());
+	const AtomPtr* fork = running_fork;
+	parallel_for (n, chunks, [&] (std::size_t, std::size_t b, std::size_t e) {
+		const std::unordered_set<Atom*>* outer = shared_envs;
+		SharedValues* outer_values = shared_values;
+		const AtomPtr* outer_fork = running_fork;
+		shared_envs = &shared;
+		shared_values = &values;
+		running_fork = fork;
+		for (std::size_t i = b; i < e; ++i) {
+			try {
+				AtomPtr args = make_atom ();
+				args->tail.push_back (l->tail.at (i));
+				results[i] = apply_function (func, args, env);
+			} catch (BreakException&) {
+				errors[i] = "break outside of a loop";
+			} catch (std::exception& err) {
+				errors[i] = err.what ();
+			}
+		}
+		shared_envs = outer;
+		shared_values = outer_values;
+		running_fork = outer_fork;
+	}, 1);
+	for (std::size_t i = 0; i < n; ++i) { // first failure in list order
+		if (errors[i].size ()) {
+			std::stringstream msg;
+			msg << "[" << (collect ? "pmap" : "pfor-each") << "] element " << i << " failed: " << errors[i];
+			throw std::runtime_error (msg.str ());
+		}
+	}
+	AtomPtr r = make_atom ();
+	if (collect) r->tail = std::move (results);
+	return r;
+}
+AtomPtr fn_pmap (AtomPtr node, AtomPtr env) {
+	return parallel_apply (node, env, true);
+}
+AtomPtr fn_pforeach (AtomPtr node, AtomPtr env) {
+	return parallel_apply (node, env, false);
+}
 AtomPtr fn_list (AtomPtr node, AtomPtr env) {
 	return node;
 }
 AtomPtr fn_lindex (AtomPtr node, AtomPtr env) {
 	AtomPtr o = type_check (node->tail.at (0), LIST);
-	int p  = (int) type_check (node->tail.at (1), ARRAY)->array[0];
+	int p  = (int) scalar_check (node->tail.at (1));
 	if (!o->tail.size ()) return make_atom  ();
 	if (p < 0 || p >= o->tail.size ()) error ("[lindex] invalid index", node);
 	return o->tail.at (p);
 }
 AtomPtr fn_lset (AtomPtr node, AtomPtr env) {
-	AtomPtr o = type_check (node->tail.at (0), LIST);
+	AtomPtr o = mutable_check (type_check (node->tail.at (0), LIST), "lset");
 	AtomPtr e = node->tail.at (1);
-	int p  = (int) type_check (node->tail.at (2), ARRAY)->array[0];
+	int p  = (int) scalar_check (node->tail.at (2));
 	if (!o->tail.size ()) return make_atom  ();
 	if (p < 0 || p >= o->tail.size ()) error ("[lset] invalid index", node);
-	o->tail.at (p) = e;
+	o->tail.set (p, e);
 	return o;
 }    
 AtomPtr fn_llength (AtomPtr node, AtomPtr env) {
 	return make_atom (type_check (node->tail.at (0), LIST)->tail.size ());
 }
 AtomPtr fn_lappend (AtomPtr n, AtomPtr env) {
-	AtomPtr dst = type_check (n->tail.at(0), LIST);
+	AtomPtr dst = mutable_check (type_check (n->tail.at(0), LIST), "lappend");
 	for (unsigned i = 1; i < n->tail.size (); ++i){
 		dst->tail.push_back (n->tail.at (i));
 	}	
@@ -713,29 +1851,33 @@ AtomPtr fn_lappend (AtomPtr n, AtomPtr env) {
 }
 AtomPtr fn_lrange (AtomPtr params, AtomPtr env) {
 	AtomPtr l = type_check (params->tail.at (0), LIST);
-	int i = (int) (type_check(params->tail.at (1), ARRAY)->array[0]);
-	int len = (int) (type_check(params->tail.at (2), ARRAY)->array[0]);
+	int i = (int) (scalar_check(params->tail.at (1)));
+	int len = (int) (scalar_check(params->tail.at (2)));
 	int end = i + len;
 	int stride = 1;
 	if (params->tail.size () == 4) {
-		stride  = (int) (type_check(params->tail.at (3), ARRAY)->array[0]);
+		stride  = (int) (scalar_check(params->tail.at (3)));
 	}
 	if (i < 0) i = 0;
 	if (len < i) len = i;
 	if (end > l->tail.size ()) end = l->tail.size ();
 	AtomPtr nl = make_atom();
+	if (stride == 1) {
+		if (i < end) nl->tail = l->tail.slice (i, end); // shares the nodes of l
+		return nl;
+	}
 	nl->tail.reserve((end - i) / stride + 1); // OPTIMIZATION
 	for (int j = i; j < end; j += stride) nl->tail.push_back(l->tail.at (j));
 	return nl;
 }
 AtomPtr fn_lreplace (AtomPtr params, AtomPtr env) {
-	AtomPtr l = type_check (params->tail.at (0), LIST);
+	AtomPtr l = mutable_check (type_check (params->tail.at (0), LIST), "lreplace");
 	AtomPtr r = type_check (params->tail.at (1), LIST);
-	int i = (int) (type_check(params->tail.at (2), ARRAY)->array[0]);
-	int len = (int) (type_check(params->tail.at (3), ARRAY)->array[0]);
+	int i = (int) (scalar_check(params->tail.at (2)));
+	int len = (int) (scalar_check(params->tail.at (3)));
 	int stride = 1;
 	if (params->tail.size () == 5) {
-		stride  = (int) (type_check(params->tail.at (4), ARRAY)->array[0]);
+		stride  = (int) (scalar_check(params->tail.at (4)));
 	}
 	if (i < 0 || len < 0 || stride < 1 || i + len  > l->tail.size () || (int) (len / stride) > r->tail.size ()) {
 		return make_atom();
@@ -743,7 +1885,7 @@ AtomPtr fn_lreplace (AtomPtr params, AtomPtr env) {
 	AtomPtr nl = make_atom();
 	int p = 0;
 	for (int j = i; j < i + len; j += stride) {
-		l->tail.at(j) = r->tail.at (p);
+		l->tail.set (j, r->tail.at (p));
 		++p;
 	}
 	return r;
@@ -752,17 +1894,260 @@ AtomPtr fn_lshuffle (AtomPtr node, AtomPtr env) {
 	std::random_device rd;
 	std::mt19937 g(rd());
 	AtomPtr ll = make_atom ();
-	ll->tail = type_check (node->tail.at (0), LIST)->tail;
-	std::shuffle (ll->tail.begin (), ll->tail.end (), g);
+	std::vector<AtomPtr> v = type_check (node->tail.at (0), LIST)->tail.to_vector ();
+	std::shuffle (v.begin (), v.end (), g);
+	ll->tail = std::move (v);
 	return ll;
 }
+AtomPtr call_function (AtomPtr f, AtomPtr a, AtomPtr b, AtomPtr env) { // (f a [b])
+	AtomPtr args = make_atom ();
+	args->tail.reserve (2);
+	args->tail.push_back (a);
+	if (b) args->tail.push_back (b);
+	return apply_function (f, args, env);
+}
+AtomPtr fn_map (AtomPtr node, AtomPtr env) {
+	AtomPtr f = node->tail.at (0);
+	AtomPtr l = type_check (node->tail.at (1), LIST);
+	AtomPtr r = make_atom ();
+	r->tail.reserve (l->tail.size ());
+	for (unsigned i = 0; i < l->tail.size (); ++i) {
+		r->tail.push_back (call_function (f, l->tail.at (i), nullptr, env));
+	}
+	return r;
+}
+AtomPtr fn_filter (AtomPtr node, AtomPtr env) {
+	AtomPtr f = node->tail.at (0);
+	AtomPtr l = type_check (node->tail.at (1), LIST);
+	AtomPtr r = make_atom ();
+	for (unsigned i = 0; i < l->tail.size (); ++i) {
+		AtomPtr t = type_check (call_function (f, l->tail.at (i), nullptr, env), ARRAY);
+		if (t->array.size () && t->array[0]) r->tail.push_back (l->tail.at (i));
+	}
+	return r;
+}
+AtomPtr fn_foldl (AtomPtr node, AtomPtr env) {
+	AtomPtr f = node->tail.at (0);
+	AtomPtr z = node->tail.at (1);
+	AtomPtr l = type_check (node->tail.at (2), LIST);
+	for (unsigned i = 0; i < l->tail.size (); ++i) {
+		z = call_function (f, z, l->tail.at (i), env);
+	}
+	return z;
+}
+AtomPtr fn_zip (AtomPtr node, AtomPtr env) {
+	AtomPtr a = type_check (node->tail.at (0), LIST);
+	AtomPtr b = type_check (node->tail.at (1), LIST);
+	std::size_t n = std::min (a->tail.size (), b->tail.size ());
+	AtomPtr r = make_atom ();
+	r->tail.reserve (n);
+	for (std::size_t i = 0; i < n; ++i) {
+		AtomPtr p = make_atom ();
+		p->tail.reserve (2);
+		p->tail.push_back (a->tail.at (i));
+		p->tail.push_back (b->tail.at (i));
+		r->tail.push_back (p);
+	}
+	return r;
+}
+AtomPtr fn_lreverse (AtomPtr node, AtomPtr env) {
+	AtomPtr l = type_check (node->tail.at (0), LIST);
+	AtomPtr r = make_atom ();
+	r->tail.assign (l->tail.rbegin (), l->tail.rend ());
+	return r;
+}
+AtomPtr fn_ltake (AtomPtr node, AtomPtr env) { // empty elements are skipped but counted
+	AtomPtr l = type_check (node->tail.at (0), LIST);
+	Real n = scalar_check (node->tail.at (1));
+	AtomPtr r = make_atom ();
+	for (unsigned i = 0; i < l->tail.size () && i < n; ++i) {
+		if (!is_nil (l->tail.at (i))) r->tail.push_back (l->tail.at (i));
+	}
+	return r;
+}
+AtomPtr fn_ldrop (AtomPtr node, AtomPtr env) {
+	AtomPtr l = type_check (node->tail.at (0), LIST);
+	Real n = scalar_check (node->tail.at (1));
+	if (n <= 0) return l;
+	AtomPtr r = make_atom ();
+	if (n < l->tail.size ()) r->tail = l->tail.slice ((std::size_t) std::ceil (n), l->tail.size ());
+	return r;
+}
+AtomPtr fn_match (AtomPtr node, AtomPtr env) {
+	AtomPtr e = node->tail.at (0);
+	AtomPtr l = type_check (node->tail.at (1), LIST);
+	AtomPtr r = make_atom ();
+	for (unsigned i = 0; i < l->tail.size (); ++i) {
+		if (atom_eq (l->tail.at (i), e)) r->tail.push_back (make_atom ((Real) i));
+	}
+	return r;
+}
+AtomPtr fn_elem (AtomPtr node, AtomPtr env) {
+	AtomPtr e = node->tail.at (0);
+	AtomPtr l = type_check (node->tail.at (1), LIST);
+	for (unsigned i = 0; i < l->tail.size (); ++i) {
+		if (atom_eq (l->tail.at (i), e)) return make_atom ((Real) 1);
+	}
+	return make_atom ((Real) 0);
+}
+AtomPtr fn_dup (AtomPtr node, AtomPtr env) {
+	Real n = scalar_check (node->tail.at (0));
+	AtomPtr r = make_atom ();
+	for (unsigned i = 0; i < n; ++i) r->tail.push_back (node->tail.at (1));
+	return r;
+}
+DictKey dict_key (AtomPtr k, AtomPtr node) {
+	if (k->type == SYMBOL || k->type == STRING) return DictKey {k->type, k->lexeme, 0};
+	if (k->type == ARRAY && array_size (k) == 1) return DictKey {ARRAY, "", array_value (k, 0) + 0.0};
+	error ("[dict] keys must be strings, symbols or scalars", node);
+	return DictKey {}; // dummy
+}
+AtomPtr key_atom (const DictKey& k) { // keys are stored as private atoms
+	if (k.type == ARRAY) return make_atom (k.value);
+	AtomPtr a = make_atom (k.lexeme);
+	a->type = k.type;
+	a->lexeme = k.lexeme;
+	return a;
+}
+void dict_set (AtomPtr d, AtomPtr k, AtomPtr v, AtomPtr node) {
+	DictKey key = dict_key (k, node);
+	auto it = d->dict ()->index.find (key);
+	if (it != d->dict ()->index.end ()) {
+		d->dict ()->entries[it->second].second = v;
+		return;
+	}
+	d->dict ()->index.emplace (key, d->dict ()->entries.size ());
+	d->dict ()->entries.emplace_back (key_atom (key), v);
+}
+AtomPtr fn_dict (AtomPtr node, AtomPtr env) {
+	if (node->tail.size () % 2) error ("[dict] keys and values must come in pairs", node);
+	AtomPtr d = make_atom ();
+	d->type = DICT;
+	d->dict () = std::make_shared<Dict> ();
+	for (unsigned i = 0; i < node->tail.size (); i += 2) {
+		dict_set (d, node->tail.at (i), node->tail.at (i + 1), node);
+	}
+	return d;
+}
+AtomPtr fn_dget (AtomPtr node, AtomPtr env) { // (dget d k [default])
+	AtomPtr d = type_check (node->tail.at (0), DICT);
+	auto it = d->dict ()->index.find (dict_key (node->tail.at (1), node));
+	if (it != d->dict ()->index.end ()) return d->dict ()->entries[it->second].second;
+	return node->tail.size () > 2 ? node->tail.at (2) : make_atom ();
+}
+AtomPtr fn_dset (AtomPtr node, AtomPtr env) { // (dset d k v [k v ...])
+	AtomPtr d = mutable_check (type_check (node->tail.at (0), DICT), "dset");
+	if (node->tail.size () % 2 == 0) error ("[dset] keys and values must come in pairs", node);
+	for (unsigned i = 1; i < node->tail.size (); i += 2) {
+		dict_set (d, node->tail.at (i), node->tail.at (i + 1), node);
+	}
+	return d;
+}
+AtomPtr fn_dhas (AtomPtr node, AtomPtr env) {
+	AtomPtr d = type_check (node->tail.at (0), DICT);
+	return make_atom ((Real) d->dict ()->index.count (dict_key (node->tail.at (1), node)));
+}
+AtomPtr fn_ddel (AtomPtr node, AtomPtr env) {
+	AtomPtr d = mutable_check (type_check (node->tail.at (0), DICT), "ddel");
+	auto it = d->dict ()->index.find (dict_key (node->tail.at (1), node));
+	if (it == d->dict ()->index.end ()) return d;
+	std::size_t p = it->second;
+	d->dict ()->index.erase (it);
+	if (p + 1 != d->dict ()->entries.size ()) { // the last entry fills the hole
+		d->dict ()->entries[p] = d->dict ()->entries.back ();
+		d->dict ()->index[dict_key (d->dict ()->entries[p].first, node)] = p;
+	}
+	d->dict ()->entries.pop_back ();
+	return d;
+}
+AtomPtr fn_dkeys (AtomPtr node, AtomPtr env) {
+	AtomPtr d = type_check (node->tail.at (0), DICT);
+	AtomPtr l = make_atom ();
+	l->tail.reserve (d->dict ()->entries.size ());
+	for (auto& kv : d->dict ()->entries) l->tail.push_back (kv.first);
+	return l;
+}
+AtomPtr fn_hash (AtomPtr node, AtomPtr env) {
+	return make_atom ((Real) (atom_hash (node->tail.at (0)) & ((1ull << 53) - 1))); // exact in a Real
+}
+AtomPtr fn_memo_call (AtomPtr node, AtomPtr env) { // (<memo-call> table f args...)
+	MemoTable* t = static_cast<MemoTable*> (node->tail.at (0)->native ().get ());
+	AtomPtr f = node->tail.at (1);
+	AtomPtr args = make_atom ();
+	args->tail = node->tail.slice (2, node->tail.size ());
+	std::size_t h = atom_hash (args);
+	{
+		std::lock_guard<std::mutex> g (t->lock);
+		auto range = t->index.equal_range (h);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (atom_eq (it->second->args, args)) {
+				t->lru.splice (t->lru.begin (), t->lru, it->second);
+				++t->hits;
+				++g_memo_hits;
+				return it->second->value;
+			}
+		}
+		++t->misses;
+		++g_memo_misses;
+	}
+	AtomPtr value = apply_function (f, args, env);
+	MemoTable::Entry e {clone (args), value, h, 0}; // keys must not change under the table
+	e.bytes = atom_bytes (e.args) + atom_bytes (value);
+	std::lock_guard<std::mutex> g (t->lock);
+	if (e.bytes > t->budget) return value;
+	t->lru.push_front (e);
+	t->index.emplace (h, t->lru.begin ());
+	t->bytes += e.bytes;
+	while (t->bytes > t->budget) { // evict least recently used
+		MemoTable::Entry& last = t->lru.back ();
+		auto range = t->index.equal_range (last.hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (&*it->second == &last) {
+				t->index.erase (it);
+				break;
+			}
+		}
+		t->bytes -= last.bytes;
+		t->lru.pop_back ();
+		++g_memo_evictions;
+	}
+	return value;
+}
+AtomPtr fn_memo (AtomPtr node, AtomPtr env) { // (memo f [bytes]) -> memoized lambda
+	AtomPtr f = type_check (node->tail.at (0), LAMBDA);
+	std::shared_ptr<MemoTable> table = std::make_shared<MemoTable> ();
+	table->budget = 16 << 20;
+	if (node->tail.size () > 1) {
+		Real b = scalar_check (node->tail.at (1));
+		if (b < 0) error ("[memo] invalid byte budget", node);
+		table->budget = (std::size_t) b;
+	}
+	AtomPtr holder = make_atom (std::valarray<Real> ()); // self-evaluating
+	holder->native () = table;
+	AtomPtr op = make_atom (&fn_memo_call);
+	op->lexeme = "memo-call";
+	op->minargs = 2;
+	AtomPtr call = make_atom ();
+	call->tail.push_back (op);
+	call->tail.push_back (holder);
+	call->tail.push_back (f);
+	AtomPtr vars = f->tail.at (0);
+	for (auto& v : vars->tail) call->tail.push_back (v);
+	AtomPtr body = make_atom ();
+	body->tail.push_back (call);
+	AtomPtr l = make_atom ();
+	l->tail.push_back (vars);
+	l->tail.push_back (body);
+	l->tail.push_back (env);
+	return make_atom (l);
+}
 void list2array (AtomPtr list, std::vector<Real>& out) {
 	for (unsigned i = 0; i < list->tail.size (); ++i) {
 		if (list->tail.at (i)->type == LIST) {
 			list2array (list->tail.at (i), out);
 		}  else if (list->tail.at (i)->type == ARRAY) {
-				for (unsigned k = 0; k < list->tail.at (i)->array.size (); ++k) {
-				out.push_back (list->tail.at (i)->array[k]);
+				for (unsigned k = 0; k < array_size (list->tail.at (i)); ++k) {
+				out.push_back (array_value (list->tail.at (i), k));
 			}
 		} else {
 			error ("numeric or list expected", list);
@@ -790,166 +2175,302 @@ AtomPtr fn_array2list (AtomPtr node, AtomPtr env) {
 AtomPtr fn_eq (AtomPtr node, AtomPtr env) {
 	return make_atom ((Real) atom_eq (node->tail.at (0), node->tail.at (1)));
 }
+template <typename T, typename Op>
+AtomPtr array_binop (AtomPtr n, Op op) {
+	ArrayArg<T> first (n->tail.at (0));
+	std::valarray<T> res (first.data, first.size);
+	for (unsigned i = 1; i < n->tail.size (); ++i) {
+		ArrayArg<T> a (n->tail.at (i));
+		std::size_t len = broadcast_size (res.size (), a.size);
+		std::valarray<T> out (len);
+		if (len) parallel_binop (&res[0], res.size (), a.data, a.size, &out[0], len, op);
+		res.swap (out);
+	}
+	return make_atom (std::move(res));
+}
 #define MAKE_ARRAYBINOP(op,name) 	\
 	AtomPtr name (AtomPtr n, AtomPtr env) { 	\
-		std::valarray<Real> res (type_check (n->tail.at (0), ARRAY)->array); \
-		for (unsigned i = 1; i < n->tail.size (); ++i) {  \
-			std::valarray<Real>& a = type_check (n->tail.at (i), ARRAY)->array; \
-			if (a.size () == 1) res = res op a[0]; \
-			else res = res op a; \
-		} \
-		return make_atom (std::move(res)); \
+		auto f = [] (auto x, auto y) { return x op y; }; \
+		return use_f32 (n) ? array_binop<float> (n, f) : array_binop<Real> (n, f); \
 	} \
 
 MAKE_ARRAYBINOP (+, fn_add);
 MAKE_ARRAYBINOP (-, fn_sub);
 MAKE_ARRAYBINOP (*, fn_mul);
 MAKE_ARRAYBINOP (/, fn_div);
+template <typename T, typename Cmp>
+AtomPtr array_cmp (AtomPtr n, Cmp cmp) {
+	std::valarray<T> res;
+	for (unsigned i = 0; i < n->tail.size () - 1; ++i) {
+		ArrayArg<T> a (n->tail.at (i));
+		ArrayArg<T> b (n->tail.at (i + 1));
+		res.resize (broadcast_size (a.size, b.size));
+		if (!res.size ()) break;
+		if (!parallel_cmp (a.data, a.size, b.data, b.size, &res[0], res.size (), cmp)) break;
+	}
+	return make_atom (std::move(res));
+}
 #define MAKE_ARRAYCMPOP(op,name) 	\
 	AtomPtr name (AtomPtr n, AtomPtr env) { 	\
-		std::valarray<bool> res; \
-		for (unsigned i = 0; i < n->tail.size () - 1; ++i) {  \
-			std::valarray<Real>& a = type_check (n->tail.at (i), ARRAY)->array; \
-			std::valarray<Real>& b = type_check (n->tail.at (i + 1), ARRAY)->array; \
-			std::valarray<bool> a_bool (a > 0); \
-			std::valarray<bool> b_bool (b > 0); \
-			if (b.size () == 1) res = a op  b[0]; \
-			else res = a op b; \
-			if (std::all_of(std::begin(res), std::end(res), [](bool i) { return !i; })) { \
-				break; \
-			} \
-		} \
-		std::valarray<Real> res_r (res.size ()); \
-		for (unsigned i = 0; i < res.size (); ++i) res_r[i] = (Real) res[i]; \
-		return make_atom (std::move(res_r)); \
+		auto f = [] (auto x, auto y) { return x op y; }; \
+		return use_f32 (n) ? array_cmp<float> (n, f) : array_cmp<Real> (n, f); \
 	} \
 
 MAKE_ARRAYCMPOP (>, fn_greater);
 MAKE_ARRAYCMPOP (>=, fn_greatereq);
 MAKE_ARRAYCMPOP (<, fn_less);
 MAKE_ARRAYCMPOP (<=, fn_lesseq);
-#define MAKE_ARRAYMETHODS(op,name)									\
-	AtomPtr name (AtomPtr n, AtomPtr env) {						\
-		std::valarray<Real> res (n->tail.size ()); \
-		for (unsigned i = 0; i < n->tail.size (); ++i) { \
-			res[i] = (type_check (n->tail.at (i), ARRAY)->array.op ()); \
-		}\
-		return make_atom (std::move(res));\
-	}\
+AtomPtr fn_size (AtomPtr n, AtomPtr env) {
+	std::valarray<Real> res (n->tail.size ());
+	for (unsigned i = 0; i < n->tail.size (); ++i) {
+		if (n->tail.at (i)->type != ARRAY) type_check (n->tail.at (i), ARRAY);
+		res[i] = array_size (n->tail.at (i));
+	}
+	return make_atom (std::move(res));
+}
+template <typename T>
+inline T variance_of (const T* x, std::size_t len) { // sample variance, 0 for a single element
+	if (len < 2) return 0;
+	T mu = parallel_sum (x, len) / len;
+	return parallel_sqdev (x, len, mu) / (len - 1);
+}
+template <typename T>
+inline std::size_t arg_index (const T* x, std::size_t len, T v) { // v not found (all NaN): 0
+	std::size_t i = find_kernel (x, len, v);
+	return i < len ? i : 0;
+}
+template <typename F>
+AtomPtr array_reduction (AtomPtr n, const char* tag, bool empty_ok, F fn) { // fn (x, len) for Real and float
+	std::valarray<Real> res (n->tail.size ());
+	for (unsigned i = 0; i < n->tail.size (); ++i) {
+		AtomPtr a = n->tail.at (i);
+		if (a->type != ARRAY) type_check (a, ARRAY);
+		std::size_t len = array_size (a);
+		if (!len && !empty_ok) error (std::string ("[") + tag + "] empty array", a);
+		if (a->f32) res[i] = len ? (Real) fn (&a->array32 ()[0], len) : 0;
+		else res[i] = len ? (Real) fn (&a->array[0], len) : 0;
+	}
+	return make_atom (std::move(res));
+}
+#define MAKE_ARRAYREDUCTION(name,tag,expr) \
+	AtomPtr name (AtomPtr n, AtomPtr env) { \
+		return array_reduction (n, tag, false, [] (auto x, std::size_t len) { return (expr); }); \
+	} \
 
-MAKE_ARRAYMETHODS (min, fn_min);
-MAKE_ARRAYMETHODS (max, fn_max);
-MAKE_ARRAYMETHODS (sum, fn_sum);
-MAKE_ARRAYMETHODS (size, fn_size);
+MAKE_ARRAYREDUCTION (fn_min, "min", parallel_min (x, len));
+MAKE_ARRAYREDUCTION (fn_max, "max", parallel_max (x, len));
+MAKE_ARRAYREDUCTION (fn_mean, "mean", parallel_sum (x, len) / len);
+MAKE_ARRAYREDUCTION (fn_variance, "variance", variance_of (x, len));
+MAKE_ARRAYREDUCTION (fn_norm, "norm", std::sqrt (parallel_dot (x, x, len)));
+MAKE_ARRAYREDUCTION (fn_argmin, "argmin", arg_index (x, len, parallel_min (x, len)));
+MAKE_ARRAYREDUCTION (fn_argmax, "argmax", arg_index (x, len, parallel_max (x, len)));
+AtomPtr fn_sum (AtomPtr n, AtomPtr env) {
+	return array_reduction (n, "sum", true, [] (auto x, std::size_t len) { return parallel_sum (x, len); });
+}
+template <typename T>
+AtomPtr array_dot (AtomPtr n) {
+	ArrayArg<T> a (n->tail.at (0));
+	ArrayArg<T> b (n->tail.at (1));
+	if (!a.size || !b.size) return make_atom (0);
+	if (a.size == b.size) return make_atom ((Real) parallel_dot (a.data, b.data, a.size));
+	if (b.size == 1) return make_atom ((Real) (parallel_sum (a.data, a.size) * b[0]));
+	if (a.size == 1) return make_atom ((Real) (parallel_sum (b.data, b.size) * a[0]));
+	error ("[dot] nonconformant arrays", n);
+	return make_atom (); // dummy
+}
+AtomPtr fn_dot (AtomPtr n, AtomPtr env) {
+	return use_f32 (n, 0, 2) ? array_dot<float> (n) : array_dot<Real> (n);
+}
+template <typename T, typename Op>
+AtomPtr array_singop (AtomPtr a, Op op) {
+	ArrayArg<T> x (a);
+	std::valarray<T> v (x.size);
+	parallel_map (x.size, [&] (std::size_t b, std::size_t e) {
+		for (std::size_t k = b; k < e; ++k) v[k] = op (x[k]);
+	});
+	return make_atom (std::move(v));
+}
 #define MAKE_ARRAYSINGOP(op,name)									\
 	AtomPtr name (AtomPtr n, AtomPtr env) {						\
+		auto f = [] (auto x) { return op (x); }; \
 		AtomPtr res = make_atom (); \
 		res->tail.reserve(n->tail.size()); \
 		for (unsigned i = 0; i < n->tail.size (); ++i) { \
-			std::valarray<Real> v = op (type_check (n->tail.at (i), ARRAY)->array); \
-			res->tail.push_back (make_atom (std::move(v))); \
+			AtomPtr a = n->tail.at (i); \
+			res->tail.push_back (a->type == ARRAY && a->f32 ? array_singop<float> (a, f) : array_singop<Real> (a, f)); \
 		}\
 		return res->tail.size () == 1 ? res->tail.at (0) : res; \
 	}\
 
 MAKE_ARRAYSINGOP (std::abs, fn_abs);
-MAKE_ARRAYSINGOP (exp, fn_exp);
-MAKE_ARRAYSINGOP (log, fn_log);
-MAKE_ARRAYSINGOP (log10, fn_log10);
-MAKE_ARRAYSINGOP (sqrt, fn_sqrt);
-MAKE_ARRAYSINGOP (sin, fn_sin);
-MAKE_ARRAYSINGOP (cos, fn_cos);
-MAKE_ARRAYSINGOP (tan, fn_tan);
-MAKE_ARRAYSINGOP (asin, fn_asin);
-MAKE_ARRAYSINGOP (acos, fn_acos);
-MAKE_ARRAYSINGOP (atan, fn_atan);
-MAKE_ARRAYSINGOP (sinh, fn_sinh);
-MAKE_ARRAYSINGOP (cosh, fn_cosh);
-MAKE_ARRAYSINGOP (tanh, fn_tanh);
-AtomPtr fn_neg (AtomPtr n, AtomPtr env) {						
-	AtomPtr res = make_atom (); 
-	res->tail.reserve(n->tail.size()); // OPTIMIZATION
-	for (unsigned i = 0; i < n->tail.size (); ++i) { 
-		std::valarray<Real> v = -(type_check (n->tail.at (i), ARRAY)->array); 
-		res->tail.push_back (make_atom (std::move(v))); 
-	}
-	return res->tail.size () == 1 ? res->tail.at (0) : res; 
-}
-AtomPtr fn_floor (AtomPtr n, AtomPtr env) {						
-	AtomPtr res = make_atom (); 
-	res->tail.reserve(n->tail.size()); // OPTIMIZATION
-	for (unsigned i = 0; i < n->tail.size (); ++i) { 
-		std::valarray<Real> v (type_check (n->tail.at (i), ARRAY)->array.size ());
-		for (unsigned j = 0; j < n->tail.at (i)->array.size (); ++j) {
-			v[j] = floor (n->tail.at (i)->array[j]); 
-		} 
-		res->tail.push_back (make_atom (std::move(v))); 
-	}
-	return res->tail.size () == 1 ? res->tail.at (0) : res; 
+MAKE_ARRAYSINGOP (std::exp, fn_exp);
+MAKE_ARRAYSINGOP (std::log, fn_log);
+MAKE_ARRAYSINGOP (std::log10, fn_log10);
+MAKE_ARRAYSINGOP (std::sqrt, fn_sqrt);
+MAKE_ARRAYSINGOP (std::sin, fn_sin);
+MAKE_ARRAYSINGOP (std::cos, fn_cos);
+MAKE_ARRAYSINGOP (std::tan, fn_tan);
+MAKE_ARRAYSINGOP (std::asin, fn_asin);
+MAKE_ARRAYSINGOP (std::acos, fn_acos);
+MAKE_ARRAYSINGOP (std::atan, fn_atan);
+MAKE_ARRAYSINGOP (std::sinh, fn_sinh);
+MAKE_ARRAYSINGOP (std::cosh, fn_cosh);
+MAKE_ARRAYSINGOP (std::tanh, fn_tanh);
+MAKE_ARRAYSINGOP (-, fn_neg);
+MAKE_ARRAYSINGOP (std::floor, fn_floor);
+template <typename T>
+AtomPtr convert_array (AtomPtr n) { // (f32 x ...), (f64 x ...)
+	AtomPtr res = make_atom ();
+	for (unsigned i = 0; i < n->tail.size (); ++i) {
+		ArrayArg<T> x (n->tail.at (i));
+		res->tail.push_back (make_atom (std::valarray<T> (x.data, x.size)));
+	}
+	return res->tail.size () == 1 ? res->tail.at (0) : res;
+}
+AtomPtr fn_f32 (AtomPtr n, AtomPtr env) {
+	return convert_array<float> (n);
+}
+AtomPtr fn_f64 (AtomPtr n, AtomPtr env) {
+	return convert_array<Real> (n);
+}
+AtomPtr fn_dtype (AtomPtr n, AtomPtr env) {
+	AtomPtr a = n->tail.at (0);
+	if (a->type != ARRAY) type_check (a, ARRAY);
+	return make_atom (std::string (a->f32 ? "f32" : "f64"));
+}
+template <typename T>
+AtomPtr array_slice (AtomPtr node, int i, int ct, int stride) {
+	std::valarray<T>& input = elements<T> (*node->tail.at (0));
+	std::valarray<T> s = input[std::slice (i, ct, stride)];
+	return make_atom (std::move(s)); // OPTIMIZATION: Move
 }
 AtomPtr fn_slice (AtomPtr node, AtomPtr env) {
-	std::valarray<Real>& input = type_check (node->tail.at (0), ARRAY)->array;
-	int i = (int) type_check  (node->tail.at (1), ARRAY)->array[0];
-	int len = (int) type_check  (node->tail.at (2), ARRAY)->array[0];
+	AtomPtr a = node->tail.at (0);
+	if (a->type != ARRAY) type_check (a, ARRAY);
+	int i = (int) scalar_check (node->tail.at (1));
+	int len = (int) scalar_check (node->tail.at (2));
 	int stride = 1;
 
-	if (node->tail.size () == 4) stride = (int) type_check  (node->tail.at (3), ARRAY)->array[0];
+	if (node->tail.size () == 4) stride = (int) scalar_check (node->tail.at (3));
 	if (i < 0 || len < 1 || stride < 1) {
 		error ("[slice] invalid indexing", node);
 	}
-	int j = i; 
+	int j = i;
 	int ct = 0;
-	while (j < input.size ()) {
+	while (j < array_size (a)) {
 		if (ct >= len) break;
 		j += stride;
 		++ct;
 	}
-	std::valarray<Real> s = input[std::slice (i, ct, stride)];
-	return make_atom (std::move(s)); // OPTIMIZATION: Move
-}    
+	return a->f32 ? array_slice<float> (node, i, ct, stride) : array_slice<Real> (node, i, ct, stride);
+}
+template <typename T>
+AtomPtr array_assign (AtomPtr node, int i, int ct, int stride) {
+	std::valarray<T>& v1 = elements<T> (*node->tail.at (0));
+	ArrayArg<T> v2 (node->tail.at (1));
+	v1[std::slice(i, ct, stride)] = std::valarray<T> (v2.data, v2.size);
+	return make_atom (std::valarray<T> (v1));
+}
 AtomPtr fn_assign (AtomPtr node, AtomPtr env) {
-	std::valarray<Real>& v1 = type_check (node->tail.at (0), ARRAY)->array;
-	std::valarray<Real>& v2 = type_check (node->tail.at (1), ARRAY)->array;
-	int i = (int) type_check  (node->tail.at (2), ARRAY)->array[0];
-	int len = (int) type_check  (node->tail.at (3), ARRAY)->array[0];
+	AtomPtr a = node->tail.at (0);
+	if (a->type != ARRAY) type_check (a, ARRAY);
+	mutable_check (a, "assign");
+	int i = (int) scalar_check (node->tail.at (2));
+	int len = (int) scalar_check (node->tail.at (3));
 	int stride = 1;
-	if (node->tail.size () == 5) stride = (int) type_check  (node->tail.at (4), ARRAY)->array[0];
+	if (node->tail.size () == 5) stride = (int) scalar_check (node->tail.at (4));
 	if (i < 0 || len < 1 || stride < 1) {
 		error ("[assign] invalid indexing", node);
 	}
-	int j = i; 
+	int j = i;
 	int ct = 0;
-	while (j < v1.size ()) {
+	while (j < array_size (a)) {
 		if (ct >= len) break;
 		j += stride;
 		++ct;
-	}        
-	v1[std::slice(i, ct, stride)] = v2;
-	return make_atom (v1);
-}  
+	}
+	return a->f32 ? array_assign<float> (node, i, ct, stride) : array_assign<Real> (node, i, ct, stride);
+}
+template <typename T>
+AtomPtr array_select (AtomPtr node) {
+	ArrayArg<T> m (node->tail.at (0));
+	ArrayArg<T> a (node->tail.at (1));
+	ArrayArg<T> b (node->tail.at (2));
+	std::size_t n = std::max (m.size, std::max (a.size, b.size));
+	if ((m.size != n && m.size != 1) || (a.size != n && a.size != 1)
+		|| (b.size != n && b.size != 1) || !m.size || !a.size || !b.size) {
+		error ("[select] nonconformant arrays", node);
+	}
+	std::valarray<T> res (n);
+	parallel_map (n, [&] (std::size_t s, std::size_t e) {
+		select_kernel (m.size == 1 ? m.data : m.data + s, m.size == 1 ? 1 : e - s,
+			a.size == 1 ? a.data : a.data + s, a.size == 1 ? 1 : e - s,
+			b.size == 1 ? b.data : b.data + s, b.size == 1 ? 1 : e - s, &res[s], e - s);
+	});
+	return make_atom (std::move(res));
+}
+AtomPtr fn_select (AtomPtr node, AtomPtr env) {
+	return use_f32 (node, 1, 3) ? array_select<float> (node) : array_select<Real> (node);
+}
+template <typename T>
+AtomPtr array_massign (AtomPtr node) {
+	AtomPtr dst = node->tail.at (0);
+	std::valarray<T>& d = elements<T> (*dst);
+	ArrayArg<T> m (node->tail.at (1));
+	ArrayArg<T> v (node->tail.at (2));
+	std::size_t n = d.size ();
+	if ((m.size != n && m.size != 1) || (v.size != n && v.size != 1)
+		|| !m.size || !v.size) {
+		error ("[massign] nonconformant arrays", node);
+	}
+	parallel_map (n, [&] (std::size_t s, std::size_t e) {
+		mask_assign_kernel (&d[s], e - s, m.size == 1 ? m.data : m.data + s, m.size == 1 ? 1 : e - s,
+			v.size == 1 ? v.data : v.data + s, v.size == 1 ? 1 : e - s);
+	});
+	return dst;
+}
+AtomPtr fn_massign (AtomPtr node, AtomPtr env) { // keeps the storage type of the destination
+	AtomPtr dst = node->tail.at (0);
+	if (dst->type != ARRAY) type_check (dst, ARRAY);
+	mutable_check (dst, "massign");
+	return dst->f32 ? array_massign<float> (node) : array_massign<Real> (node);
+}
 template <int mode>
 AtomPtr fn_format (AtomPtr node, AtomPtr env) {
-	std::stringstream tmp;
-	for (unsigned i = mode == 2 ? 1 : 0; i < node->tail.size (); ++i) {
-		print (node->tail.at (i), tmp, mode == 2); // set write flag if necessary
-	}
 	switch (mode) {
-		case 0: // print
-			std::cout << tmp.str (); std::cout.flush ();
+		case 0: { // print (buffered, see flush_output)
+			std::stringstream tmp; // one write per call for concurrent tasks
+			for (unsigned i = 0; i < node->tail.size (); ++i) print (node->tail.at (i), tmp);
+			output () << tmp.str ();
 			return make_atom ("");
-		break;
-		case 1: // to string
-			return make_atom ((std::string) "\"" + tmp.str ());
-		break;
-		case 2: // save
+		} break;
+		case 1: { // to string
+			std::stringstream tmp;
+			for (unsigned i = 0; i < node->tail.size (); ++i) print (node->tail.at (i), tmp);
+			return make_string (tmp.str ());
+		} break;
+		case 2: { // save, written straight to the file
 			std::string fname = node->tail.at (0)->lexeme;
-			std::ofstream out (fname);
+			std::vector<char> buf (1 << 16);
+			std::ofstream out;
+			out.rdbuf ()->pubsetbuf (buf.data (), buf.size ());
+			out.open (fname);
 			if (!out.good ()) return make_atom (0);
-			out << tmp.str ();
+			for (unsigned i = 1; i < node->tail.size (); ++i) print (node->tail.at (i), out, true);
 			out.close ();
 			return make_atom(1);
-		break;	
+		} break;	
+	}
+	return make_atom (); // dummy
+}
+AtomPtr fn_precision (AtomPtr node, AtomPtr env) { // (precision [digits]), 0 = shortest exact
+	if (node->tail.size () > 0) {
+		int p = (int) scalar_check (node->tail.at (0));
+		if (p < 0 || p > 17) error ("[precision] invalid number of digits", node);
+		if (script_io) script_io->precision = p;
+		else g_print_precision = p;
 	}
+	return make_atom ((Real) print_precision ());
 }
 AtomPtr fn_read (AtomPtr node, AtomPtr env) {
     unsigned linenum = 0;
@@ -975,19 +2496,36 @@ void replace (std::string &s, std::string from, std::string to) {
 		idx = next + to.size ();
 	} 
 }
-std::vector<std::string> split (const std::string& in, char separator) {
-	std::istringstream iss(in);
-	std::string s;
-	std::vector<std::string> tokens;
-	while (std::getline(iss, s, separator)) {
-		tokens.push_back (s);
+std::vector<std::string_view> split (std::string_view in, char separator) { // views into in
+	std::vector<std::string_view> tokens;
+	std::size_t pos = 0;
+	while (pos < in.size ()) { // like getline: no token after a trailing separator
+		std::size_t next = in.find (separator, pos);
+		if (next == std::string_view::npos) next = in.size ();
+		tokens.push_back (in.substr (pos, next - pos));
+		pos = next + 1;
 	}
 	return tokens;
 }
+AtomPtr match_groups (const std::smatch& m) {
+	AtomPtr l = make_atom();
+	l->tail.reserve(m.size()); // OPTIMIZATION
+	for(auto v: m) {
+		l->tail.push_back (make_string (v.str()));
+	}
+	return l;
+}
+AtomPtr fn_regex (AtomPtr node, AtomPtr env) {
+	const std::string& pattern = type_check (node->tail.at (0), STRING)->lexeme;
+	AtomPtr r = make_atom ();
+	r->type = REGEX;
+	r->lexeme = pattern;
+	r->native () = compile_regex (pattern, node->tail.at (0));
+	return r;
+}
 AtomPtr fn_string (AtomPtr node, AtomPtr env) {
 	std::string cmd = type_check (node->tail.at (0), SYMBOL)->lexeme;
 	AtomPtr l = make_atom();
-	std::regex r;
 	if (cmd == "length") { // argnum checked by default
 		return make_atom(type_check (node->tail.at(1), STRING)->lexeme.size ());
 	} else if (cmd == "find") {
@@ -998,41 +2536,76 @@ AtomPtr fn_string (AtomPtr node, AtomPtr env) {
 		else return make_atom (pos);		
 	} else if (cmd == "range") {
 		args_check (node, 4);
-		std::string tmp = type_check (node->tail.at(1), STRING)->lexeme.substr(
-			type_check (node->tail.at(2), ARRAY)->array[0], 
-			type_check (node->tail.at(3), ARRAY)->array[0]);
-		return make_atom ((std::string) "\"" + tmp);
+		std::string_view src = type_check (node->tail.at(1), STRING)->lexeme;
+		std::size_t pos = (std::size_t) scalar_check (node->tail.at(2));
+		if (pos > src.size ()) error ("[str] invalid range", node);
+		return make_string (std::string (src.substr (pos, 
+			(std::size_t) scalar_check (node->tail.at(3)))));
 	} else if (cmd == "replace") {
 		args_check (node, 4);
 		std::string tmp = type_check (node->tail.at(1), STRING)->lexeme;
 		replace (tmp,
 			type_check (node->tail.at(2), STRING)->lexeme, 
 			type_check (node->tail.at(3), STRING)->lexeme);
-		return make_atom((std::string) "\"" + tmp);
+		return make_string (std::move (tmp));
 	} else if (cmd == "split") {
 		args_check (node, 3);
-		std::string tmp = type_check (node->tail.at(1), STRING)->lexeme;
+		const std::string& tmp = type_check (node->tail.at(1), STRING)->lexeme;
 		char sep =  type_check (node->tail.at(2), STRING)->lexeme[0];
-		std::vector<std::string> tokens = split (tmp, sep);
+		std::vector<std::string_view> tokens = split (tmp, sep);
 		AtomPtr l = make_atom ();
 		l->tail.reserve(tokens.size()); // OPTIMIZATION
-		for (unsigned i = 0; i < tokens.size (); ++i) l->tail.push_back (make_atom ((std::string) "\"" + tokens[i]));
+		for (unsigned i = 0; i < tokens.size (); ++i) l->tail.push_back (make_string (std::string (tokens[i])));
 		return l;
 	} else if (cmd == "regex") {
 		args_check (node, 3);
-		std::string str = type_check (node->tail.at(1), STRING)->lexeme;
-		std::regex r (type_check (node->tail.at(2), STRING)->lexeme);
+		const std::string& str = type_check (node->tail.at(1), STRING)->lexeme;
+		std::shared_ptr<Regex> r = get_regex (node->tail.at(2));
 		std::smatch m; 
-		std::regex_search(str, m, r);
-		AtomPtr l = make_atom();
-		l->tail.reserve(m.size()); // OPTIMIZATION
-		for(auto v: m) {
-			l->tail.push_back (make_atom ((std::string) "\"" + v.str()));
+		std::regex_search(str, m, r->re);
+		return match_groups (m);
+	} else if (cmd == "match-all") { // groups of every non-overlapping match
+		args_check (node, 3);
+		const std::string& str = type_check (node->tail.at(1), STRING)->lexeme;
+		std::shared_ptr<Regex> r = get_regex (node->tail.at(2));
+		for (std::sregex_iterator it (str.begin (), str.end (), r->re), end; it != end; ++it) {
+			l->tail.push_back (match_groups (*it));
 		}
-		return l;		
+		return l;
 	} 
 	return l;
 }
+void append_text (std::string& out, AtomPtr a) { // as print would show a
+	if (a->type == STRING || a->type == SYMBOL) out += a->lexeme;
+	else {
+		std::stringstream tmp;
+		print (a, tmp);
+		out += tmp.str ();
+	}
+}
+AtomPtr fn_strbuild (AtomPtr node, AtomPtr env) { // (strbuild) -> new buffer, (strbuild buf x ...) appends in place
+	AtomPtr buf = node->tail.size () ? type_check (node->tail.at (0), STRING) : make_string ("");
+	if (buf->buffer) mutable_check (buf, "strbuild");
+	else { // other strings (literals in code) are copied into a new buffer
+		buf = make_string (buf->lexeme);
+		buf->buffer = true;
+	}
+	for (unsigned i = 1; i < node->tail.size (); ++i) append_text (buf->lexeme, node->tail.at (i));
+	return buf;
+}
+AtomPtr fn_strjoin (AtomPtr node, AtomPtr env) { // (strjoin list [sep])
+	AtomPtr l = type_check (node->tail.at (0), LIST);
+	std::string sep = node->tail.size () > 1 ? type_check (node->tail.at (1), STRING)->lexeme : "";
+	std::string out;
+	std::size_t len = sep.size () * l->tail.size ();
+	for (auto& e : l->tail) if (e->type == STRING || e->type == SYMBOL) len += e->lexeme.size ();
+	out.reserve (len);
+	for (auto it = l->tail.begin (); it != l->tail.end (); ++it) {
+		if (it != l->tail.begin ()) out += sep;
+		append_text (out, *it);
+	}
+	return make_string (std::move (out));
+}
 static std::string get_home_directory() {
     std::string home;
 #ifdef _WIN32
@@ -1049,7 +2622,183 @@ static std::string get_home_directory() {
     if (home.empty()) home = ".";
     return home;
 }
+// load-time constant folding: calls of pure primitives whose arguments are
+// constants and whose value is a scalar are replaced by that value, symbols
+// bound by (def name literal) by the literal. A loaded form that is a macro
+// call is expanded first (so (function name args body) is folded as its def).
+// Arguments of macros, quote and calls of unknown functions are left alone,
+// lambda parameters and names defined in lambda bodies shadow globals, and
+// code calling a macro, eval or load (which may define any name) is not
+// folded. Rebinding a name (extend) or changing an inlined value in place
+// (mutable_check) restores the code
+AtomPtr fn_load (AtomPtr node, AtomPtr env);
+bool is_pure_op (Functor f) {
+	static const std::unordered_set<Functor> pure {
+		&fn_add, &fn_sub, &fn_mul, &fn_div, &fn_eq, &fn_less, &fn_lesseq, &fn_greater, &fn_greatereq,
+		&fn_min, &fn_max, &fn_sum, &fn_mean, &fn_variance, &fn_norm, &fn_dot, &fn_argmin, &fn_argmax,
+		&fn_size, &fn_sin, &fn_cos, &fn_tan, &fn_asin, &fn_acos, &fn_atan, &fn_sinh, &fn_cosh, &fn_tanh,
+		&fn_log, &fn_log10, &fn_sqrt, &fn_exp, &fn_abs, &fn_neg, &fn_floor
+	};
+	return pure.count (f);
+}
+struct Folder {
+	AtomPtr env;
+	std::vector<std::string> bound; // parameters of the enclosing lambdas
+	AtomPtr lookup (const AtomPtr& sym) { // nullptr if unbound or shadowed
+		if (sym->type != SYMBOL || !sym->lexeme.size ()) return nullptr;
+		if (std::find (bound.begin (), bound.end (), sym->lexeme) != bound.end ()) return nullptr;
+		for (AtomPtr e = env; !is_nil (e); e = e->tail.at (0)) {
+			if (!e->cache_valid) build_cache (e);
+			auto it = e->cache.find (sym->lexeme);
+			if (it != e->cache.end ()) return it->second;
+		}
+		return nullptr;
+	}
+	bool dynamic (const AtomPtr& node) { // calls a macro, eval or load
+		if (node->type != LIST || node->tail.size () == 0) return false;
+		AtomPtr f = lookup (node->tail.at (0));
+		if (f && (f->type == MACRO || (f->type == OP && (f->op == &fn_eval || f->op == &fn_load)))) return true;
+		for (auto& e : node->tail) if (dynamic (e)) return true;
+		return false;
+	}
+	bool is_constant (const AtomPtr& v) {
+		std::lock_guard<std::mutex> g (g_folds.lock);
+		auto it = g_folds.constants.find (v.get ());
+		return it != g_folds.constants.end () && it->second.value.lock () == v;
+	}
+	void release (const AtomPtr& sym) { // sym is the target of =: it is a variable, not a constant
+		AtomPtr v = lookup (sym);
+		if (v && v->inlined && !v->frozen) fold_release (v); // code of frozen envs stays as it is
+	}
+	// names defined or set in a lambda body are not inlined in it: set ones may
+	// be copied into a fork whose base holds the folded code (see extend)
+	void bind_defs (const AtomPtr& node) {
+		if (node->type != LIST || node->tail.size () < 2) return;
+		AtomPtr f = lookup (node->tail.at (0));
+		if (f && f->type == OP && (f->op == &fn_def || f->op == &fn_set) && node->tail.at (1)->type == SYMBOL) {
+			if (f->op == &fn_set) release (node->tail.at (1));
+			bound.push_back (node->tail.at (1)->lexeme);
+		}
+		for (auto& e : node->tail) bind_defs (e);
+	}
+	void record (const AtomPtr& parent, std::size_t index, const AtomPtr& original, const AtomPtr& folded,
+		std::vector<std::string>& deps) {
+		std::sort (deps.begin (), deps.end ());
+		deps.erase (std::unique (deps.begin (), deps.end ()), deps.end ());
+		std::lock_guard<std::mutex> g (g_folds.lock);
+		for (const std::string& d : deps) {
+			std::vector<FoldSite>& v = g_folds.sites[d];
+			if (v.size () >= 64 && !(v.size () & (v.size () - 1))) { // drop sites of freed code
+				v.erase (std::remove_if (v.begin (), v.end (), [] (const FoldSite& s) { return s.parent.expired (); }), v.end ());
+			}
+			v.push_back (FoldSite {parent, index, original, folded, env});
+			g_folds.names |= FoldTable::bit (d);
+		}
+		++(folded->type == ARRAY && original->type == SYMBOL ? g_folds.inlined : g_folds.folded);
+	}
+	void fold_at (const AtomPtr& node, std::size_t i, std::vector<std::string>& deps) {
+		std::vector<std::string> d;
+		AtomPtr child = node->tail.at (i);
+		AtomPtr r = fold (child, d);
+		if (r == child) return;
+		node->tail.set (i, r);
+		record (node, i, child, r, d);
+		deps.insert (deps.end (), d.begin (), d.end ());
+	}
+	AtomPtr fold (const AtomPtr& node, std::vector<std::string>& deps) { // replacement of node, or node
+		if (node->type == SYMBOL) {
+			AtomPtr v = lookup (node);
+			if (!v || v->type != ARRAY || !is_constant (v)) return node;
+			deps.push_back (node->lexeme);
+			return v;
+		}
+		if (node->type != LIST || node->tail.size () == 0) return node;
+		AtomPtr head = node->tail.at (0);
+		if (head->type == LIST) {
+			fold_at (node, 0, deps);
+			return node;
+		}
+		AtomPtr f = lookup (head);
+		if (!f || f->type == MACRO) return node;
+		if (f->type == OP && (f->op == &fn_quote || f->op == &fn_bench || f->op == &fn_break)) return node;
+		if (f->type == OP && (f->op == &fn_def || f->op == &fn_set)) {
+			if (f->op == &fn_set && node->tail.size () > 1) release (node->tail.at (1));
+			if (node->tail.size () > 2) fold_at (node, 2, deps);
+			return node;
+		}
+		if (f->type == OP && (f->op == &fn_lambda || f->op == &fn_macro)) { // bodies are copied: fold inside them only
+			if (node->tail.size () < 3 || node->tail.at (1)->type != LIST) return node;
+			std::size_t n = bound.size ();
+			for (auto& p : node->tail.at (1)->tail) bound.push_back (p->lexeme);
+			for (std::size_t i = 2; i < node->tail.size (); ++i) {
+				if (dynamic (node->tail.at (i))) {
+					bound.resize (n);
+					return node;
+				}
+			}
+			for (std::size_t i = 2; i < node->tail.size (); ++i) bind_defs (node->tail.at (i));
+			for (std::size_t i = 2; i < node->tail.size (); ++i) {
+				std::vector<std::string> d;
+				fold (node->tail.at (i), d);
+			}
+			bound.resize (n);
+			return node;
+		}
+		std::vector<std::string> d;
+		for (std::size_t i = 1; i < node->tail.size (); ++i) fold_at (node, i, d);
+		if (f->type != OP || !is_pure_op (f->op) || node->tail.size () - 1 < f->minargs) return node;
+		AtomPtr args = make_atom ();
+		for (std::size_t i = 1; i < node->tail.size (); ++i) {
+			if (node->tail.at (i)->type != ARRAY) return node;
+			args->tail.push_back (node->tail.at (i));
+		}
+		AtomPtr r;
+		try {
+			r = f->op (args, env);
+		} catch (...) {
+			return node; // reported when evaluated
+		}
+		if (r->type != ARRAY || array_size (r) != 1) return node; // fresh arrays stay fresh
+		deps.insert (deps.end (), d.begin (), d.end ());
+		deps.push_back (head->lexeme);
+		return r;
+	}
+};
+AtomPtr expand (AtomPtr form, AtomPtr env) { // form, or the expansion of the macro it calls, as eval does
+	Folder f {env, {}};
+	while (form->type == LIST && form->tail.size ()) {
+		AtomPtr m = f.lookup (form->tail.at (0));
+		if (!m || m->type != MACRO) break;
+		AtomPtr args = make_atom ();
+		for (std::size_t i = 1; i < form->tail.size (); ++i) args->tail.push_back (form->tail.at (i));
+		AtomPtr nenv = make_frame (m, args, form);
+		if (nenv->type != LIST) break; // partial application, left to eval
+		AtomPtr body = m->tail.at (1);
+		AtomPtr expansion = make_atom ();
+		for (std::size_t i = 0; i < body->tail.size (); ++i) expansion = eval (body->tail.at (i), nenv);
+		form = expansion;
+	}
+	return form;
+}
+AtomPtr fold (AtomPtr node, AtomPtr env) {
+	if (!folds_enabled ()) return node;
+	node = expand (node, env);
+	Folder f {env, {}};
+	if (f.dynamic (node)) return node;
+	std::vector<std::string> deps;
+	return f.fold (node, deps);
+}
+void fold_mark_constant (AtomPtr form, AtomPtr value, AtomPtr env) { // after (def name literal)
+	if (form->type != LIST || form->tail.size () != 3 || form->tail.at (2)->type != ARRAY) return;
+	if (value != form->tail.at (2)) return;
+	AtomPtr f = Folder {env, {}}.lookup (form->tail.at (0));
+	if (!f || f->type != OP || f->op != &fn_def) return;
+	std::lock_guard<std::mutex> g (g_folds.lock);
+	g_folds.constants[value.get ()] = FoldConstant {value, env, form->tail.at (1)->lexeme};
+	value->inlined = true;
+}
 AtomPtr load (const std::string&fname, AtomPtr env) {
+	ForkScope fork (env);
     std::ifstream in (fname);
 	if (!in.good ()) {
 		for (unsigned i = 0; i < env->paths.size (); ++i) {
@@ -1072,11 +2821,19 @@ AtomPtr load (const std::string&fname, AtomPtr env) {
             AtomPtr l = read(in, linenum);
             if (!l && in.eof()) break;
             if (!l) continue;
+            l = fold (l, env);
             r = eval(l, env);
+            fold_mark_constant (l, r, env);
+            flush_output ();
+        } catch (ExitException&) {
+            flush_output ();
+            throw;
         } catch (std::exception& e) {
-            std::cerr << "[" << fname << ":" << linenum << "] " << e.what () << std::endl;
+            error_output () << "[" << fname << ":" << linenum << "] " << e.what () << std::endl;
+            if (script_io) ++script_io->errors;
         } catch (...) {
-            std::cerr << "unknown error detected" << std::endl;
+            error_output () << "unknown error detected" << std::endl;
+            if (script_io) ++script_io->errors;
         }
     }
     return r;
@@ -1088,6 +2845,7 @@ AtomPtr fn_exec (AtomPtr node, AtomPtr env) {
 	return make_atom (system (type_check (node->tail.at (0), STRING)->lexeme.c_str ()));
 }
 AtomPtr fn_exit (AtomPtr node, AtomPtr env) {
+	if (exit_throws) throw ExitException {};
 	std::cout << std::endl;
 	exit (0);
 	return make_atom ();
@@ -1098,6 +2856,9 @@ void add_op (const std::string& lexeme, Functor f, int minargs, AtomPtr env) {
 	AtomPtr op = make_atom(f);
 	op->lexeme = lexeme;
 	op->minargs = minargs;
+	std::shared_ptr<OpSlot> slot = std::make_shared<OpSlot> ();
+	slot->counters = OpStats::instance ().slot (lexeme);
+	op->native () = slot;
 	extend (make_atom(lexeme), op, env);
 }
 AtomPtr add_core (AtomPtr env) {
@@ -1113,6 +2874,11 @@ AtomPtr add_core (AtomPtr env) {
 	add_op ("eval", &fn_eval, 1, env);
 	add_op ("apply", &fn_apply, 2, env);
 	add_op ("info", &fn_info, 1, env);  
+	add_op ("threads", &fn_threads, 0, env);  
+	add_op ("pmap", &fn_pmap, 2, env);  
+	add_op ("%profile", &fn_profile, 1, env);  
+	add_op ("bench", &fn_bench, -1, env);
+	add_op ("pfor-each", &fn_pforeach, 2, env);  
 	add_op ("list", &fn_list, 0, env);
 	add_op ("lappend", &fn_lappend, 1, env);
 	add_op ("lreplace", &fn_lreplace, 4, env);
@@ -1121,6 +2887,25 @@ AtomPtr add_core (AtomPtr env) {
 	add_op ("lset", &fn_lset, 3, env);
 	add_op ("llength", &fn_llength, 1, env);
 	add_op ("lshuffle", &fn_lshuffle, 1, env); 	
+	add_op ("map", &fn_map, 2, env);
+	add_op ("filter", &fn_filter, 2, env);
+	add_op ("foldl", &fn_foldl, 3, env);
+	add_op ("zip", &fn_zip, 2, env);
+	add_op ("lreverse", &fn_lreverse, 1, env);
+	add_op ("ltake", &fn_ltake, 2, env);
+	add_op ("ldrop", &fn_ldrop, 2, env);
+	add_op ("match", &fn_match, 2, env);
+	add_op ("elem", &fn_elem, 2, env);
+	add_op ("dup", &fn_dup, 2, env);
+	add_op ("dict", &fn_dict, 0, env);
+	add_op ("dget", &fn_dget, 2, env);
+	add_op ("dset", &fn_dset, 3, env);
+	add_op ("dhas", &fn_dhas, 2, env);
+	add_op ("ddel", &fn_ddel, 2, env);
+	add_op ("dkeys", &fn_dkeys, 1, env);
+	add_op ("hash", &fn_hash, 1, env);
+	add_op ("memo", &fn_memo, 1, env);
+	add_op ("regex", &fn_regex, 1, env);
     add_op ("array", &fn_array, 0, env);    
 	add_op ("array2list", &fn_array2list, 1, env);
 	add_op ("==", &fn_eq, 2, env);
@@ -1135,7 +2920,16 @@ AtomPtr add_core (AtomPtr env) {
     add_op ("min", &fn_min, 1, env);    
     add_op ("max", &fn_max, 1, env);    
     add_op ("sum", &fn_sum, 1, env);   
-	add_op ("size", &fn_size, 1, env);   
+    add_op ("mean", &fn_mean, 1, env);   
+    add_op ("variance", &fn_variance, 1, env);   
+    add_op ("norm", &fn_norm, 1, env);   
+    add_op ("dot", &fn_dot, 2, env);   
+    add_op ("argmin", &fn_argmin, 1, env);   
+    add_op ("argmax", &fn_argmax, 1, env);   
+	add_op ("size", &fn_size, 1, env);
+	add_op ("f32", &fn_f32, 1, env);
+	add_op ("f64", &fn_f64, 1, env);
+	add_op ("dtype", &fn_dtype, 1, env);   
 	add_op ("sin", &fn_sin, 1, env);    
 	add_op ("cos", &fn_cos, 1, env); 
 	add_op ("tan", &fn_tan, 1, env); 
@@ -1154,11 +2948,16 @@ AtomPtr add_core (AtomPtr env) {
 	add_op ("floor", &fn_floor, 1, env);
 	add_op ("slice", fn_slice, 3, env);   
 	add_op ("assign", fn_assign, 4, env);     	
+	add_op ("select", &fn_select, 3, env);
+	add_op ("massign", &fn_massign, 3, env);
 	add_op ("print", &fn_format<0>, 1, env);
 	add_op ("tostr", &fn_format<1>, 1, env);
+	add_op ("precision", &fn_precision, 0, env);
 	add_op ("save", &fn_format<2>, 2, env);
 	add_op ("read", &fn_read, 0, env);
     add_op ("str", &fn_string, 2, env);
+	add_op ("strbuild", &fn_strbuild, 0, env);
+	add_op ("strjoin", &fn_strjoin, 1, env);
 	add_op ("load", &fn_load, 0, env);
 	add_op ("exec", &fn_exec, 1, env);
 	add_op ("exit", &fn_exit, 0, env);
@@ -11,10 +11,28 @@
 ;; (schedule (lambda () ...) delay)
 ;; expands to:
 ;;   (%schedule <that-lambda> delay)
+;; and returns an event handle for (cancel event)
 (def schedule
   (macro (thunk delay)
     (list '%schedule thunk delay)))
 
+;; schedule-beat macro:
+;; (schedule-beat (lambda () ...) beat clock)
+;; runs the thunk at an absolute beat of a (tempo ...) clock
+(def schedule-beat
+  (macro (thunk beat clock)
+    (list '%schedule thunk beat clock)))
+
+;; profile macro:
+;; (profile expr)
+;; expands to:
+;;   (%profile (lambda () expr))
+;; samples expr every millisecond, prints the top frames and writes the
+;; folded stacks to musil.folded
+(def profile
+  (macro (expr)
+    (list '%profile (list 'lambda '() expr))))
+
 ;; function macro:
 ;; (function name (args...) body)
 ;; expands to:
@@ -149,91 +167,16 @@
 (function ltail (l)
   (lappend '() (llast l)))
 
-(function ltake (l n)
-  {
-    (def ltake-runner
-      (lambda (acc l n)
-        (if (<= n 0)
-            acc
-            {
-              (if (eq (car l) '()) acc (lappend acc (car l)))
-              (ltake-runner acc (cdr l) (- n 1))
-            })))
-    (ltake-runner '() l n)
-  })
-
-(function ldrop (l n)
-  (if (<= n 0)
-      l
-      (ldrop (cdr l) (- n 1))))
-
+;; ltake, ldrop, lreverse, match, elem, zip and dup are native
+;; (reference definitions in tests/test_core.scm)
 (function lsplit (l n)
   (list (ltake l n) (ldrop l n)))
 
-;; iterative reverse
-(function lreverse (l)
-  {
-    (def res '())
-    (def i (- (llength l) 1))
-    (while (>= i 0)
-      {
-        (lappend res (lindex l i))
-        (= i (- i 1))
-      })
-    res
-  })
-
-(function match (e l)
-  {
-    (def match-runner
-      (lambda (acc n e l)
-        (if (eq l '())
-            acc
-            {
-              (if (eq (car l) e) (lappend acc n) acc)
-              (match-runner acc (+ n 1) e (cdr l))
-            })))
-    (match-runner '() 0 e l)
-  })
-
-(function elem (x l)
-  (if (eq (llength (match x l)) 0)
-      false
-      true))
-
-(function zip (l1 l2)
-  (map2 list l1 l2))
-
-(function dup (n x)
-  {
-    (def dup-runner
-      (lambda (acc n x)
-        (if (<= n 0)
-            acc
-            {
-              (lappend acc x)
-              (dup-runner acc (- n 1) x)
-            })))
-    (dup-runner '() n x)
-  })
-
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; Higher-order operators
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
-(function map (f l)
-  {
-    (def map-runner
-      (lambda (acc f l)
-        (if (eq l '())
-            acc
-            {
-              (lappend acc (f (car l)))
-              (map-runner acc f (cdr l))
-            })))
-    (map-runner '() f l)
-  })
-
+;; map, filter and foldl are native
 (function map2 (f l1 l2)
   {
     (def map2-runner
@@ -247,24 +190,6 @@
     (map2-runner '() f l1 l2)
   })
 
-(function filter (f l)
-  {
-    (def filter-runner
-      (lambda (acc f l)
-        (if (eq l '())
-            acc
-            {
-              (if (f (car l)) (lappend acc (car l)) acc)
-              (filter-runner acc f (cdr l))
-            })))
-    (filter-runner '() f l)
-  })
-
-(function foldl (f z l)
-  (if (eq l '())
-      z
-      (foldl f (f z (car l)) (cdr l))))
-
 (function flip (f a b)
   (f b a))
 
@@ -305,16 +230,9 @@
 (function round (x)
   (floor (+ x 0.5)))
 
-;; mean of an array
-(function mean (x)
-  (/ (sum x) (size x)))
-
+;; mean, variance, dot and norm are native reductions
 (function stddev (x)
-  {
-    (def mu (mean x))
-    (def normal (/ 1. (- (size x) 1)))
-    (sqrt (* (sum (square (- x mu))) normal))
-  })
+  (sqrt (variance x)))
 
 (function standard (x)
   {
@@ -326,15 +244,9 @@
 (function normal (x)
   (/ x (max x)))
 
-(function dot (a b)
-  (sum (* a b)))
-
 (function ortho (a b)
   (eq (dot a b) 0))
 
-(function norm (x)
-  (sqrt (sum (* x x))))
-
 (function diff (x)
   (- (slice x 1 (size x)) x))
 
@@ -0,0 +1,82 @@
+// OpStats.h
+//
+// Per-primitive instrumentation. Every op registered by name gets a set of
+// counters (calls, time, array elements and a log2 histogram of argument
+// sizes) shared by all environments defining it. Counting is off by default
+// and costs a relaxed atomic load per primitive call; when on, counters are
+// updated with relaxed atomics, so parallel callers need no locking.
+
+#ifndef OPSTATS_H
+#define OPSTATS_H
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+struct OpCounters {
+    static constexpr unsigned BUCKETS = 24; // sizes up to 2^23, larger ones go in the last bucket
+    std::atomic<std::uint64_t> calls {0}, ns {0}, elements {0};
+    std::array<std::atomic<std::uint64_t>, BUCKETS> sizes {}; // bucket b: largest array in [2^(b-1), 2^b)
+
+    void add (std::uint64_t t_ns, std::size_t elems, std::size_t largest) {
+        calls.fetch_add (1, std::memory_order_relaxed);
+        ns.fetch_add (t_ns, std::memory_order_relaxed);
+        elements.fetch_add (elems, std::memory_order_relaxed);
+        unsigned b = 0;
+        while (largest && b < BUCKETS - 1) {
+            largest >>= 1;
+            ++b;
+        }
+        sizes[b].fetch_add (1, std::memory_order_relaxed);
+    }
+    void reset () {
+        calls = 0;
+        ns = 0;
+        elements = 0;
+        for (auto& s : sizes) s = 0;
+    }
+};
+
+class OpStats {
+public:
+    static OpStats& instance () {
+        static OpStats stats;
+        return stats;
+    }
+    // counters of the op called name, created on first use
+    std::shared_ptr<OpCounters> slot (const std::string& name) {
+        std::lock_guard<std::mutex> g (_lock);
+        std::shared_ptr<OpCounters>& c = _ops[name];
+        if (!c) c = std::make_shared<OpCounters> ();
+        return c;
+    }
+    template <typename F>
+    void for_each (F f) {
+        std::lock_guard<std::mutex> g (_lock);
+        for (auto& o : _ops) f (o.first, *o.second);
+    }
+    void reset () {
+        std::lock_guard<std::mutex> g (_lock);
+        for (auto& o : _ops) o.second->reset ();
+    }
+    bool enabled () const {
+        return _enabled.load (std::memory_order_relaxed);
+    }
+    void enable (bool on) {
+        _enabled.store (on, std::memory_order_relaxed);
+    }
+
+private:
+    OpStats () {}
+    std::mutex _lock;
+    std::map<std::string, std::shared_ptr<OpCounters>> _ops;
+    std::atomic<bool> _enabled {false};
+};
+
+#endif // OPSTATS_H
+
+// eof
@@ -0,0 +1,316 @@
+// PVector.h
+//
+// Persistent vector used for list tails. Short vectors are stored flat,
+// longer ones as a balanced (AVL) tree of chunks whose nodes are shared
+// between copies: copying is O(1), slicing, concatenation, append and
+// update are O(log n) and only copy the path they touch. Nodes owned by a
+// single vector are updated in place.
+
+#ifndef PVECTOR_H
+#define PVECTOR_H
+
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <stdexcept>
+#include <algorithm>
+#include <cstddef>
+
+template <typename T>
+class PVector {
+public:
+    static const std::size_t CHUNK = 64; // elements per leaf
+
+    class const_iterator;
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_iterator iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
+    PVector () {}
+    PVector (const std::vector<T>& v) { assign (v.begin (), v.end ()); }
+    PVector (std::vector<T>&& v) {
+        if (v.size () <= CHUNK) _items = std::move (v);
+        else assign (v.begin (), v.end ());
+    }
+    template <typename It>
+    PVector (It first, It last) { assign (first, last); }
+
+    std::size_t size () const { return _root ? _root->size : _items.size (); }
+    bool empty () const { return size () == 0; }
+    void reserve (std::size_t n) { if (!_root && n <= CHUNK) _items.reserve (n); }
+    void clear () { _items.clear (); _root.reset (); }
+    std::size_t capacity () const { return _root ? capacity (_root.get ()) : _items.capacity (); } // slots, shared leaves included
+
+    const T& at (std::size_t i) const {
+        if (!_root) return _items.at (i);
+        if (i >= _root->size) throw std::out_of_range ("PVector::at");
+        return find (_root.get (), i);
+    }
+    const T& operator[] (std::size_t i) const {
+        return _root ? find (_root.get (), i) : _items[i];
+    }
+    const T& front () const { return at (0); }
+    const T& back () const { return at (size () - 1); }
+
+    void set (std::size_t i, const T& v) {
+        if (!_root) {
+            _items.at (i) = v;
+            return;
+        }
+        if (i >= _root->size) throw std::out_of_range ("PVector::set");
+        update (_root, i, v);
+    }
+    void push_back (const T& v) {
+        if (!_root) {
+            if (_items.size () < CHUNK) {
+                _items.push_back (v);
+                return;
+            }
+            _root = make_leaf (std::move (_items));
+            _items.clear ();
+        }
+        push (_root, v);
+    }
+    void append (const PVector& o) { // concatenation, shares the nodes of o
+        if (!_root && !o._root && _items.size () + o._items.size () <= CHUNK) {
+            _items.insert (_items.end (), o._items.begin (), o._items.end ());
+            return;
+        }
+        NodePtr r = join (tree (), o.tree ());
+        _items.clear ();
+        _root = r;
+    }
+    PVector slice (std::size_t b, std::size_t e) const { // [b, e)
+        PVector r;
+        e = std::min (e, size ());
+        if (b >= e) return r;
+        if (!_root) {
+            r._items.assign (_items.begin () + b, _items.begin () + e);
+            return r;
+        }
+        r._root = cut (_root, b, e);
+        r.flatten ();
+        return r;
+    }
+    template <typename It>
+    void assign (It first, It last) {
+        clear ();
+        std::vector<NodePtr> leaves;
+        std::vector<T> chunk;
+        for (; first != last; ++first) {
+            if (chunk.size () == CHUNK) {
+                leaves.push_back (make_leaf (std::move (chunk)));
+                chunk.clear ();
+            }
+            chunk.push_back (*first);
+        }
+        if (leaves.empty ()) {
+            _items = std::move (chunk);
+            return;
+        }
+        if (chunk.size ()) leaves.push_back (make_leaf (std::move (chunk)));
+        _root = build (leaves, 0, leaves.size ());
+    }
+    std::vector<T> to_vector () const {
+        return std::vector<T> (begin (), end ());
+    }
+
+    const_iterator begin () const { return const_iterator (this, 0); }
+    const_iterator end () const { return const_iterator (this, size ()); }
+    const_reverse_iterator rbegin () const { return const_reverse_iterator (end ()); }
+    const_reverse_iterator rend () const { return const_reverse_iterator (begin ()); }
+
+    // random access iterator; remembers the leaf it is in
+    class const_iterator {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator () {}
+        const_iterator (const PVector* v, std::size_t i) : _v (v), _i (i) {}
+        reference operator* () const {
+            if (_i < _lb || _i >= _le) locate ();
+            return _leaf[_i - _lb];
+        }
+        pointer operator-> () const { return &**this; }
+        reference operator[] (difference_type n) const { return *(*this + n); }
+        const_iterator& operator++ () { ++_i; return *this; }
+        const_iterator operator++ (int) { const_iterator t = *this; ++_i; return t; }
+        const_iterator& operator-- () { --_i; return *this; }
+        const_iterator operator-- (int) { const_iterator t = *this; --_i; return t; }
+        const_iterator& operator+= (difference_type n) { _i += n; return *this; }
+        const_iterator& operator-= (difference_type n) { _i -= n; return *this; }
+        const_iterator operator+ (difference_type n) const { const_iterator t = *this; return t += n; }
+        const_iterator operator- (difference_type n) const { const_iterator t = *this; return t -= n; }
+        difference_type operator- (const const_iterator& o) const {
+            return (difference_type) _i - (difference_type) o._i;
+        }
+        bool operator== (const const_iterator& o) const { return _i == o._i; }
+        bool operator!= (const const_iterator& o) const { return _i != o._i; }
+        bool operator< (const const_iterator& o) const { return _i < o._i; }
+        bool operator> (const const_iterator& o) const { return _i > o._i; }
+        bool operator<= (const const_iterator& o) const { return _i <= o._i; }
+        bool operator>= (const const_iterator& o) const { return _i >= o._i; }
+
+    private:
+        void locate () const {
+            if (!_v->_root) {
+                _leaf = _v->_items.data ();
+                _lb = 0;
+                _le = _v->_items.size ();
+                return;
+            }
+            const Node* n = _v->_root.get ();
+            std::size_t b = 0;
+            while (n->left) {
+                if (_i - b < n->left->size) n = n->left.get ();
+                else {
+                    b += n->left->size;
+                    n = n->right.get ();
+                }
+            }
+            _leaf = n->items.data ();
+            _lb = b;
+            _le = b + n->items.size ();
+        }
+        const PVector* _v = nullptr;
+        std::size_t _i = 0;
+        mutable const T* _leaf = nullptr;
+        mutable std::size_t _lb = 0, _le = 0;
+    };
+
+private:
+    struct Node;
+    typedef std::shared_ptr<Node> NodePtr;
+    struct Node { // leaf when left is null
+        std::size_t size = 0;
+        int height = 0;
+        NodePtr left, right;
+        std::vector<T> items;
+    };
+
+    static NodePtr make_leaf (std::vector<T>&& items) {
+        NodePtr n = std::make_shared<Node> ();
+        n->items = std::move (items);
+        n->size = n->items.size ();
+        return n;
+    }
+    static NodePtr make_node (const NodePtr& l, const NodePtr& r) {
+        NodePtr n = std::make_shared<Node> ();
+        n->left = l;
+        n->right = r;
+        n->size = l->size + r->size;
+        n->height = 1 + std::max (l->height, r->height);
+        return n;
+    }
+    static int height (const NodePtr& n) { return n ? n->height : -1; }
+    static std::size_t capacity (const Node* n) {
+        return n->left ? capacity (n->left.get ()) + capacity (n->right.get ()) : n->items.capacity ();
+    }
+    static const T& find (const Node* n, std::size_t i) {
+        while (n->left) {
+            if (i < n->left->size) n = n->left.get ();
+            else {
+                i -= n->left->size;
+                n = n->right.get ();
+            }
+        }
+        return n->items[i];
+    }
+    static NodePtr build (const std::vector<NodePtr>& leaves, std::size_t b, std::size_t e) {
+        if (e - b == 1) return leaves[b];
+        std::size_t m = b + (e - b) / 2;
+        return make_node (build (leaves, b, m), build (leaves, m, e));
+    }
+    static NodePtr rotate_left (const NodePtr& n) {
+        return make_node (make_node (n->left, n->right->left), n->right->right);
+    }
+    static NodePtr rotate_right (const NodePtr& n) {
+        return make_node (n->left->left, make_node (n->left->right, n->right));
+    }
+    static NodePtr balance (const NodePtr& n) {
+        int d = height (n->left) - height (n->right);
+        if (d > 1) {
+            if (height (n->left->left) >= height (n->left->right)) return rotate_right (n);
+            return rotate_right (make_node (rotate_left (n->left), n->right));
+        }
+        if (d < -1) {
+            if (height (n->right->right) >= height (n->right->left)) return rotate_left (n);
+            return rotate_left (make_node (n->left, rotate_right (n->right)));
+        }
+        return n;
+    }
+    static NodePtr join (const NodePtr& a, const NodePtr& b) {
+        if (!a || !a->size) return b;
+        if (!b || !b->size) return a;
+        if (!a->left && !b->left && a->size + b->size <= CHUNK) {
+            std::vector<T> items (a->items);
+            items.insert (items.end (), b->items.begin (), b->items.end ());
+            return make_leaf (std::move (items));
+        }
+        if (a->height > b->height + 1) return balance (make_node (a->left, join (a->right, b)));
+        if (b->height > a->height + 1) return balance (make_node (join (a, b->left), b->right));
+        return make_node (a, b);
+    }
+    static NodePtr cut (const NodePtr& n, std::size_t b, std::size_t e) {
+        if (b == 0 && e == n->size) return n;
+        if (!n->left) {
+            return make_leaf (std::vector<T> (n->items.begin () + b, n->items.begin () + e));
+        }
+        std::size_t ls = n->left->size;
+        if (e <= ls) return cut (n->left, b, e);
+        if (b >= ls) return cut (n->right, b - ls, e - ls);
+        return join (cut (n->left, b, ls), cut (n->right, 0, e - ls));
+    }
+    static void own (NodePtr& n) { // copy on write
+        if (n.use_count () > 1) n = std::make_shared<Node> (*n);
+    }
+    static void update (NodePtr& n, std::size_t i, const T& v) {
+        own (n);
+        if (!n->left) {
+            n->items[i] = v;
+            return;
+        }
+        if (i < n->left->size) update (n->left, i, v);
+        else update (n->right, i - n->left->size, v);
+    }
+    static void push (NodePtr& n, const T& v) {
+        own (n);
+        if (!n->left) {
+            if (n->items.size () < CHUNK) {
+                n->items.push_back (v);
+                ++n->size;
+            } else {
+                n = make_node (n, make_leaf (std::vector<T> (1, v)));
+            }
+            return;
+        }
+        push (n->right, v);
+        ++n->size;
+        n->height = 1 + std::max (n->left->height, n->right->height);
+        n = balance (n);
+    }
+    NodePtr tree () const {
+        if (_root) return _root;
+        if (_items.empty ()) return NodePtr ();
+        return make_leaf (std::vector<T> (_items));
+    }
+    void flatten () { // short trees go back to the flat layout
+        if (_root && _root->size <= CHUNK) {
+            _items = std::vector<T> (begin (), end ());
+            _root.reset ();
+        }
+    }
+
+    std::vector<T> _items; // flat layout, when _root is null
+    NodePtr _root;
+};
+
+#endif // PVECTOR_H
+
+// eof
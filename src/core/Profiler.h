@@ -0,0 +1,107 @@
+// Profiler.h
+//
+// Sampling profiler. A timer thread counts ticks; the profiled thread
+// polls them and, when some are pending, charges them to its current
+// stack (frames separated by ';'). Stacks are only touched by the profiled
+// thread, so sampling needs no locking. Output is in the folded format read
+// by flamegraph tools, plus a top-N summary of self and total samples.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <map>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_set>
+
+class Profiler {
+public:
+    explicit Profiler (unsigned interval_us = 1000) : _interval (interval_us) {}
+    ~Profiler () {
+        stop ();
+    }
+    void start () {
+        if (_running) return;
+        _running = true;
+        _timer = std::thread ([this] () {
+            while (_running) {
+                std::this_thread::sleep_for (std::chrono::microseconds (_interval));
+                _ticks.fetch_add (1, std::memory_order_relaxed);
+            }
+        });
+    }
+    void stop () {
+        _running = false;
+        if (_timer.joinable ()) _timer.join ();
+    }
+    bool due () const {
+        return _ticks.load (std::memory_order_relaxed) != 0;
+    }
+    // ticks elapsed since the last call
+    std::size_t take () {
+        return _ticks.exchange (0, std::memory_order_relaxed);
+    }
+    void add (const std::string& stack, std::size_t n) {
+        _stacks[stack] += n;
+        _samples += n;
+    }
+    std::size_t samples () const {
+        return _samples;
+    }
+    unsigned interval_us () const {
+        return _interval;
+    }
+    void write_folded (std::ostream& out) const {
+        for (auto& s : _stacks) out << s.first << " " << s.second << "\n";
+    }
+    // frames sorted by self samples (time in the frame itself)
+    void write_summary (std::ostream& out, std::size_t top = 10) const {
+        std::map<std::string, std::size_t> self, total;
+        for (auto& s : _stacks) {
+            std::unordered_set<std::string> seen; // recursion counts once
+            std::size_t b = 0;
+            while (true) {
+                std::size_t e = s.first.find (';', b);
+                std::string frame = s.first.substr (b, e == std::string::npos ? e : e - b);
+                if (seen.insert (frame).second) total[frame] += s.second;
+                if (e == std::string::npos) {
+                    self[frame] += s.second;
+                    break;
+                }
+                b = e + 1;
+            }
+        }
+        std::vector<std::pair<std::string, std::size_t>> rows (self.begin (), self.end ());
+        std::sort (rows.begin (), rows.end (), [] (const auto& a, const auto& b) {
+            return a.second > b.second;
+        });
+        out << _samples << " samples every " << _interval << " us\n";
+        if (!_samples) return;
+        out << "   self%  total%  frame\n";
+        for (std::size_t i = 0; i < rows.size () && i < top; ++i) {
+            out << std::fixed << std::setprecision (1)
+                << std::setw (8) << 100. * rows[i].second / _samples
+                << std::setw (8) << 100. * total[rows[i].first] / _samples
+                << "  " << rows[i].first << "\n";
+        }
+        out << std::defaultfloat;
+    }
+
+private:
+    unsigned _interval;
+    std::atomic<bool> _running {false};
+    std::atomic<std::size_t> _ticks {0};
+    std::thread _timer;
+    std::map<std::string, std::size_t> _stacks;
+    std::size_t _samples = 0;
+};
+
+#endif // PROFILER_H
+
+// eof
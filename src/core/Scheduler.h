@@ -0,0 +1,136 @@
+// Scheduler.h
+//
+// Process-wide event scheduler. A single thread sleeps until the earliest
+// deadline of a heap of events (steady_clock) and runs due callbacks one at
+// a time, in deadline order. Events can be cancelled until they start; the
+// lateness of every event against its deadline is recorded as jitter.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_set>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+class Scheduler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stats {
+        std::size_t fired = 0, cancelled = 0, pending = 0;
+        double mean_us = 0, max_us = 0, stddev_us = 0; // jitter
+    };
+
+    static Scheduler& instance () {
+        static Scheduler scheduler;
+        return scheduler;
+    }
+    ~Scheduler () {
+        {
+            std::lock_guard<std::mutex> g (_lock);
+            _stop = true;
+        }
+        _wake.notify_all ();
+        if (!_thread.joinable ()) return;
+        if (_thread.get_id () == std::this_thread::get_id ()) _thread.detach (); // exit from a callback
+        else _thread.join ();
+    }
+
+    // runs fn on the scheduler thread at due; returns the id used by cancel
+    std::uint64_t post (Clock::time_point due, std::function<void ()> fn) {
+        std::uint64_t id;
+        {
+            std::lock_guard<std::mutex> g (_lock);
+            if (!_thread.joinable ()) _thread = std::thread ([this] () { loop (); });
+            id = ++_last_id;
+            _events.push (Event {due, id, std::move (fn)});
+            _pending.insert (id);
+        }
+        _wake.notify_one ();
+        return id;
+    }
+    // true if the event had not started yet
+    bool cancel (std::uint64_t id) {
+        std::lock_guard<std::mutex> g (_lock);
+        if (!_pending.erase (id)) return false;
+        ++_cancelled;
+        return true;
+    }
+    Stats stats () {
+        std::lock_guard<std::mutex> g (_lock);
+        Stats s;
+        s.fired = _fired;
+        s.cancelled = _cancelled;
+        s.pending = _pending.size ();
+        if (_fired) {
+            s.mean_us = _sum / _fired;
+            s.max_us = _max;
+            s.stddev_us = std::sqrt (std::max (0., _sumsq / _fired - s.mean_us * s.mean_us));
+        }
+        return s;
+    }
+    void reset_stats () {
+        std::lock_guard<std::mutex> g (_lock);
+        _fired = _cancelled = 0;
+        _sum = _sumsq = _max = 0;
+    }
+
+private:
+    struct Event {
+        Clock::time_point due;
+        std::uint64_t id;
+        std::function<void ()> fn;
+        bool operator> (const Event& e) const { // earliest first, FIFO on ties
+            return due > e.due || (due == e.due && id > e.id);
+        }
+    };
+
+    Scheduler () {}
+    void loop () {
+        std::unique_lock<std::mutex> g (_lock);
+        while (!_stop) {
+            if (_events.empty ()) {
+                _wake.wait (g);
+                continue;
+            }
+            Clock::time_point due = _events.top ().due;
+            if (Clock::now () < due) {
+                _wake.wait_until (g, due); // woken early by post, cancel or stop
+                continue;
+            }
+            Event e = _events.top ();
+            _events.pop ();
+            if (!_pending.erase (e.id)) continue; // cancelled
+            double late = std::chrono::duration<double, std::micro> (Clock::now () - e.due).count ();
+            ++_fired;
+            _sum += late;
+            _sumsq += late * late;
+            if (late > _max) _max = late;
+            g.unlock ();
+            e.fn (); // callbacks handle their own errors
+            g.lock ();
+        }
+    }
+
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::thread _thread;
+    bool _stop = false;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> _events;
+    std::unordered_set<std::uint64_t> _pending;
+    std::uint64_t _last_id = 0;
+    std::size_t _fired = 0, _cancelled = 0;
+    double _sum = 0, _sumsq = 0, _max = 0;
+};
+
+#endif // SCHEDULER_H
+
+// eof
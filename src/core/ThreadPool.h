@@ -0,0 +1,218 @@
+// ThreadPool.h
+//
+// Process-wide work-stealing thread pool. Every worker owns a deque: it
+// pops its own tasks from the back and steals from the front of the
+// others. Threads waiting on a TaskGroup run pending tasks instead of
+// blocking, so tasks can submit and wait on nested groups.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+
+// ---------------------------------------------------------
+// TaskGroup: counts the pending tasks of a batch and keeps the first
+// exception thrown by one of them.
+// ---------------------------------------------------------
+struct TaskGroup {
+    std::atomic<std::size_t> pending {0};
+    std::exception_ptr error;
+    std::mutex lock;
+    void fail (std::exception_ptr e) {
+        std::lock_guard<std::mutex> g (lock);
+        if (!error) error = e;
+    }
+};
+
+class ThreadPool {
+public:
+    static ThreadPool& instance () {
+        static ThreadPool pool;
+        return pool;
+    }
+    ~ThreadPool () {
+        _workers->stop ();
+    }
+    // total parallelism: n - 1 workers plus the thread that waits; the new
+    // workers replace the old ones, which finish the tasks already queued
+    void resize (std::size_t n) {
+        if (worker_index () >= 0) {
+            throw std::runtime_error ("[threads] cannot resize the pool from a pool task");
+        }
+        std::lock_guard<std::mutex> g (_resize);
+        std::shared_ptr<Workers> old = current ();
+        std::atomic_store (&_workers, std::make_shared<Workers> (n < 1 ? 1 : n));
+        old->stop ();
+    }
+    std::size_t size () const {
+        return current ()->queues.size () + 1;
+    }
+    void submit (TaskGroup& group, std::function<void ()> fn) {
+        ++group.pending;
+        Task t {&group, std::move (fn)};
+        std::shared_ptr<Workers> hold;
+        Workers* p = pool_of_thread (hold);
+        while (!p->queues.empty ()) { // counted first: stopping workers wait for it
+            {
+                std::lock_guard<std::mutex> g (p->idle_lock);
+                if (!p->stopping || worker_pool () == p) {
+                    ++p->queued;
+                    break;
+                }
+            }
+            hold = current (); // replaced by resize
+            p = hold.get ();
+        }
+        if (p->queues.empty ()) { // no workers: run inline
+            run (t);
+            return;
+        }
+        int w = worker_index ();
+        std::size_t q = w >= 0 ? (std::size_t) w : p->next++ % p->queues.size ();
+        {
+            std::lock_guard<std::mutex> g (p->queues[q]->lock);
+            p->queues[q]->tasks.push_back (std::move (t));
+        }
+        p->idle.notify_one ();
+    }
+    // runs pending tasks until the group is done, then rethrows its error
+    void wait (TaskGroup& group) {
+        std::shared_ptr<Workers> hold;
+        Workers* p = pool_of_thread (hold);
+        while (group.pending.load () > 0) {
+            Task t;
+            if (p->take (worker_index (), t)) run (t);
+            else std::this_thread::yield ();
+        }
+        if (group.error) std::rethrow_exception (group.error);
+    }
+    static int& worker_index () {
+        static thread_local int index = -1;
+        return index;
+    }
+
+private:
+    struct Task {
+        TaskGroup* group = nullptr;
+        std::function<void ()> fn;
+    };
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+    // one generation of workers: its queues never change while it is in use
+    struct Workers {
+        std::vector<std::unique_ptr<Queue> > queues;
+        std::vector<std::thread> threads;
+        std::atomic<std::size_t> next {0};
+        std::mutex idle_lock;
+        std::condition_variable idle;
+        std::size_t queued = 0;
+        bool stopping = false;
+
+        explicit Workers (std::size_t n) {
+            for (std::size_t i = 0; i + 1 < n; ++i) {
+                queues.emplace_back (new Queue);
+            }
+            for (std::size_t i = 0; i + 1 < n; ++i) {
+                threads.emplace_back ([this, i] () { loop ((int) i); });
+            }
+        }
+        void stop () { // workers leave once the queues are empty
+            {
+                std::lock_guard<std::mutex> g (idle_lock);
+                stopping = true;
+            }
+            idle.notify_all ();
+            for (auto& w : threads) w.join ();
+            threads.clear ();
+        }
+        void loop (int index) {
+            worker_index () = index;
+            worker_pool () = this;
+            while (true) {
+                Task t;
+                if (take (index, t)) {
+                    run (t);
+                    continue;
+                }
+                std::unique_lock<std::mutex> g (idle_lock);
+                idle.wait (g, [this] () { return stopping || queued > 0; });
+                if (stopping && queued == 0) return;
+            }
+        }
+        // own queue first (LIFO), then steal from the others (FIFO)
+        bool take (int self, Task& t) {
+            std::size_t n = queues.size ();
+            if (!n) return false;
+            if (self >= 0) {
+                Queue& q = *queues[(std::size_t) self];
+                std::lock_guard<std::mutex> g (q.lock);
+                if (!q.tasks.empty ()) {
+                    t = std::move (q.tasks.back ());
+                    q.tasks.pop_back ();
+                    return taken ();
+                }
+            }
+            std::size_t first = self >= 0 ? (std::size_t) self + 1 : 0;
+            for (std::size_t k = 0; k < n; ++k) {
+                Queue& q = *queues[(first + k) % n];
+                std::lock_guard<std::mutex> g (q.lock);
+                if (!q.tasks.empty ()) {
+                    t = std::move (q.tasks.front ());
+                    q.tasks.pop_front ();
+                    return taken ();
+                }
+            }
+            return false;
+        }
+        bool taken () {
+            std::lock_guard<std::mutex> g (idle_lock);
+            --queued;
+            return true;
+        }
+    };
+
+    ThreadPool () {
+        unsigned hw = std::thread::hardware_concurrency ();
+        _workers = std::make_shared<Workers> (hw ? hw : 1);
+    }
+    static Workers*& worker_pool () { // generation of a worker thread
+        static thread_local Workers* pool = nullptr;
+        return pool;
+    }
+    std::shared_ptr<Workers> current () const {
+        return std::atomic_load (&_workers);
+    }
+    // workers stay in their own generation (kept alive until they are
+    // joined), other threads use the current one and hold it
+    Workers* pool_of_thread (std::shared_ptr<Workers>& hold) const {
+        if (worker_pool ()) return worker_pool ();
+        hold = current ();
+        return hold.get ();
+    }
+    static void run (Task& t) {
+        try {
+            t.fn ();
+        } catch (...) {
+            t.group->fail (std::current_exception ());
+        }
+        --t.group->pending;
+    }
+
+    std::shared_ptr<Workers> _workers;
+    std::mutex _resize;
+};
+
+#endif // THREADPOOL_H
+
+// eof
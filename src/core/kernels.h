@@ -0,0 +1,205 @@
+// kernels.h
+//
+// Elementwise array kernels used by the core primitives. Loops run over raw
+// pointers and are branch-free so that the compiler can map them on SIMD
+// lanes; MUSIL_SIMD marks the ones that must be vectorized.
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+
+#ifdef MUSIL_OPENMP_SIMD
+#define MUSIL_SIMD _Pragma("omp simd")
+#define MUSIL_SIMD_REDUCTION(r) _Pragma(MUSIL_STR(omp simd reduction(r)))
+#else
+#define MUSIL_SIMD
+#define MUSIL_SIMD_REDUCTION(r)
+#endif
+#define MUSIL_STR(x) #x
+
+// ---------------------------------------------------------
+// broadcast_size(na, nb)
+//   Result size of an elementwise operation: size-1 operands are
+//   broadcast, otherwise the shorter operand wins.
+// ---------------------------------------------------------
+inline std::size_t broadcast_size(std::size_t na, std::size_t nb) {
+    if (na == 1) return nb;
+    if (nb == 1) return na;
+    return na < nb ? na : nb;
+}
+
+// ---------------------------------------------------------
+// binop_kernel<T>(a, na, b, nb, out, n, op)
+//   out[i] = op(a[i], b[i]) for i < n; size-1 operands are broadcast.
+//   out may alias a or b.
+// ---------------------------------------------------------
+template <typename T, typename Op>
+void binop_kernel(const T* a, std::size_t na, const T* b, std::size_t nb,
+                  T* out, std::size_t n, Op op) {
+    if (na != 1 && nb != 1) {
+        MUSIL_SIMD
+        for (std::size_t i = 0; i < n; ++i) out[i] = op(a[i], b[i]);
+    } else if (nb == 1) {
+        const T s = b[0];
+        MUSIL_SIMD
+        for (std::size_t i = 0; i < n; ++i) out[i] = op(a[i], s);
+    } else {
+        const T s = a[0];
+        MUSIL_SIMD
+        for (std::size_t i = 0; i < n; ++i) out[i] = op(s, b[i]);
+    }
+}
+
+// ---------------------------------------------------------
+// cmp_kernel<T>(a, na, b, nb, out, n, cmp)
+//   out[i] = cmp(a[i], b[i]) as 0/1 masks for i < n; size-1 operands
+//   are broadcast. Returns the number of true elements.
+// ---------------------------------------------------------
+template <typename T, typename Cmp>
+std::size_t cmp_kernel(const T* a, std::size_t na, const T* b, std::size_t nb,
+                       T* out, std::size_t n, Cmp cmp) {
+    T count = 0;
+    if (na != 1 && nb != 1) {
+        MUSIL_SIMD
+        for (std::size_t i = 0; i < n; ++i) out[i] = cmp(a[i], b[i]) ? T(1) : T(0);
+    } else if (nb == 1) {
+        const T s = b[0];
+        MUSIL_SIMD
+        for (std::size_t i = 0; i < n; ++i) out[i] = cmp(a[i], s) ? T(1) : T(0);
+    } else {
+        const T s = a[0];
+        MUSIL_SIMD
+        for (std::size_t i = 0; i < n; ++i) out[i] = cmp(s, b[i]) ? T(1) : T(0);
+    }
+    MUSIL_SIMD_REDUCTION(+:count)
+    for (std::size_t i = 0; i < n; ++i) count += out[i];
+    return (std::size_t) count;
+}
+
+// ---------------------------------------------------------
+// select_kernel<T>(m, nm, a, na, b, nb, out, n)
+//   out[i] = m[i] ? a[i] : b[i]; size-1 operands are broadcast.
+// ---------------------------------------------------------
+template <typename T>
+void select_kernel(const T* m, std::size_t nm, const T* a, std::size_t na,
+                   const T* b, std::size_t nb, T* out, std::size_t n) {
+    if (nm == n && na == n && nb == n) {
+        MUSIL_SIMD
+        for (std::size_t i = 0; i < n; ++i) {
+            const T x = a[i], y = b[i];
+            out[i] = m[i] != 0 ? x : y;
+        }
+        return;
+    }
+    const std::size_t sm = nm == 1 ? 0 : 1;
+    const std::size_t sa = na == 1 ? 0 : 1;
+    const std::size_t sb = nb == 1 ? 0 : 1;
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i] = m[i * sm] != 0 ? a[i * sa] : b[i * sb];
+    }
+}
+
+// ---------------------------------------------------------
+// mask_assign_kernel<T>(dst, n, m, nm, src, ns)
+//   dst[i] = src[i] where m[i] is true, in place.
+// ---------------------------------------------------------
+template <typename T>
+void mask_assign_kernel(T* dst, std::size_t n, const T* m, std::size_t nm,
+                        const T* src, std::size_t ns) {
+    if (nm == n && ns == n) {
+        MUSIL_SIMD
+        for (std::size_t i = 0; i < n; ++i) {
+            const T x = src[i], y = dst[i];
+            dst[i] = m[i] != 0 ? x : y;
+        }
+        return;
+    }
+    const std::size_t sm = nm == 1 ? 0 : 1;
+    const std::size_t ss = ns == 1 ? 0 : 1;
+    for (std::size_t i = 0; i < n; ++i) {
+        dst[i] = m[i * sm] != 0 ? src[i * ss] : dst[i];
+    }
+}
+
+// ---------------------------------------------------------
+// pairwise_sum<T>(x, n), pairwise_dot<T>(a, b, n)
+//   Pairwise summation: blocks of KERNEL_BLOCK elements are summed on
+//   SIMD lanes, blocks are combined as a balanced binary tree. The error
+//   grows as O(log n) instead of O(n) for naive accumulation.
+// ---------------------------------------------------------
+const std::size_t KERNEL_BLOCK = 128;
+
+template <typename T>
+T pairwise_sum(const T* x, std::size_t n) {
+    if (n <= KERNEL_BLOCK) {
+        T s = 0;
+        MUSIL_SIMD_REDUCTION(+:s)
+        for (std::size_t i = 0; i < n; ++i) s += x[i];
+        return s;
+    }
+    std::size_t h = (n / 2 + KERNEL_BLOCK - 1) / KERNEL_BLOCK * KERNEL_BLOCK;
+    return pairwise_sum(x, h) + pairwise_sum(x + h, n - h);
+}
+template <typename T>
+T pairwise_dot(const T* a, const T* b, std::size_t n) {
+    if (n <= KERNEL_BLOCK) {
+        T s = 0;
+        MUSIL_SIMD_REDUCTION(+:s)
+        for (std::size_t i = 0; i < n; ++i) s += a[i] * b[i];
+        return s;
+    }
+    std::size_t h = (n / 2 + KERNEL_BLOCK - 1) / KERNEL_BLOCK * KERNEL_BLOCK;
+    return pairwise_dot(a, b, h) + pairwise_dot(a + h, b + h, n - h);
+}
+
+// ---------------------------------------------------------
+// pairwise_sqdev<T>(x, n, mu)
+//   Pairwise sum of (x[i] - mu)^2, second pass of the variance.
+// ---------------------------------------------------------
+template <typename T>
+T pairwise_sqdev(const T* x, std::size_t n, T mu) {
+    if (n <= KERNEL_BLOCK) {
+        T s = 0;
+        MUSIL_SIMD_REDUCTION(+:s)
+        for (std::size_t i = 0; i < n; ++i) s += (x[i] - mu) * (x[i] - mu);
+        return s;
+    }
+    std::size_t h = (n / 2 + KERNEL_BLOCK - 1) / KERNEL_BLOCK * KERNEL_BLOCK;
+    return pairwise_sqdev(x, h, mu) + pairwise_sqdev(x + h, n - h, mu);
+}
+
+// ---------------------------------------------------------
+// min_kernel<T>(x, n), max_kernel<T>(x, n)
+//   n must be positive.
+// ---------------------------------------------------------
+template <typename T>
+T min_kernel(const T* x, std::size_t n) {
+    T m = x[0];
+    MUSIL_SIMD_REDUCTION(min:m)
+    for (std::size_t i = 0; i < n; ++i) m = x[i] < m ? x[i] : m;
+    return m;
+}
+template <typename T>
+T max_kernel(const T* x, std::size_t n) {
+    T m = x[0];
+    MUSIL_SIMD_REDUCTION(max:m)
+    for (std::size_t i = 0; i < n; ++i) m = x[i] > m ? x[i] : m;
+    return m;
+}
+
+// ---------------------------------------------------------
+// find_kernel<T>(x, n, v)
+//   Index of the first element equal to v, n if not found.
+// ---------------------------------------------------------
+template <typename T>
+std::size_t find_kernel(const T* x, std::size_t n, T v) {
+    for (std::size_t i = 0; i < n; ++i) {
+        if (x[i] == v) return i;
+    }
+    return n;
+}
+
+#endif // KERNELS_H
+
+// eof
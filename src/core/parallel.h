@@ -0,0 +1,163 @@
+// parallel.h
+//
+// Chunked execution of array kernels on the shared ThreadPool. Chunk
+// boundaries depend only on the array size and on the thread count, and
+// partial results are combined in chunk order: reductions are reproducible
+// for a fixed number of threads.
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "kernels.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+inline std::atomic<std::size_t> g_parallel_threshold {1 << 18}; // elements
+
+inline std::size_t parallel_threads() {
+    return ThreadPool::instance ().size ();
+}
+
+// ---------------------------------------------------------
+// parallel_chunks(n)
+//   Number of chunks used for n elements (or n units of work).
+// ---------------------------------------------------------
+inline std::size_t parallel_chunks(std::size_t n) {
+    if (n < g_parallel_threshold) return 1;
+    return parallel_threads ();
+}
+
+// ---------------------------------------------------------
+// parallel_for<F>(n, chunks, fn, grain)
+//   Calls fn(c, begin, end) for every chunk c; chunk sizes are multiples
+//   of grain. Chunk 0 runs on the calling thread, which then helps the
+//   pool until every chunk is done.
+// ---------------------------------------------------------
+template <typename F>
+void parallel_for(std::size_t n, std::size_t chunks, F fn,
+                  std::size_t grain = KERNEL_BLOCK) {
+    if (chunks <= 1) {
+        fn (0, 0, n);
+        return;
+    }
+    std::size_t step = (n + chunks - 1) / chunks;
+    step = (step + grain - 1) / grain * grain;
+    ThreadPool& pool = ThreadPool::instance ();
+    TaskGroup group;
+    for (std::size_t c = 1; c < chunks; ++c) {
+        std::size_t b = std::min (n, c * step);
+        std::size_t e = std::min (n, b + step);
+        if (b < e) pool.submit (group, [=, &fn] () { fn (c, b, e); });
+    }
+    try {
+        fn (0, 0, std::min (n, step));
+    } catch (...) {
+        try { pool.wait (group); } catch (...) {}
+        throw;
+    }
+    pool.wait (group);
+}
+
+// ---------------------------------------------------------
+// parallel_map<F>(n, fn)
+//   Elementwise kernel fn(begin, end) chunked over the pool.
+// ---------------------------------------------------------
+template <typename F>
+void parallel_map(std::size_t n, F fn) {
+    parallel_for (n, parallel_chunks (n), [&fn] (std::size_t, std::size_t b, std::size_t e) {
+        if (b < e) fn (b, e);
+    });
+}
+
+// ---------------------------------------------------------
+// parallel_reduce<T, F, G>(n, kernel, combine)
+//   kernel(begin, end) reduces a chunk, combine(partials, k) the results.
+// ---------------------------------------------------------
+template <typename T, typename F, typename G>
+T parallel_reduce(std::size_t n, F kernel, G combine) {
+    std::size_t chunks = parallel_chunks (n);
+    if (chunks == 1) return kernel (0, n);
+    std::vector<T> partials (chunks, T (0));
+    std::vector<char> used (chunks, 0);
+    parallel_for (n, chunks, [&] (std::size_t c, std::size_t b, std::size_t e) {
+        if (b < e) {
+            partials[c] = kernel (b, e);
+            used[c] = 1;
+        }
+    });
+    std::size_t k = 0;
+    for (std::size_t c = 0; c < chunks; ++c) {
+        if (used[c]) partials[k++] = partials[c];
+    }
+    return combine (partials.data (), k);
+}
+
+// ---------------------------------------------------------
+// parallel_binop<T, Op>(a, na, b, nb, out, n, op)
+// parallel_cmp<T, Cmp>(a, na, b, nb, out, n, cmp)
+//   Chunked versions of binop_kernel and cmp_kernel; size-1 operands
+//   are broadcast.
+// ---------------------------------------------------------
+template <typename T, typename Op>
+void parallel_binop(const T* a, std::size_t na, const T* b, std::size_t nb,
+                    T* out, std::size_t n, Op op) {
+    parallel_map (n, [=] (std::size_t s, std::size_t e) {
+        binop_kernel (na == 1 ? a : a + s, na == 1 ? 1 : e - s,
+                      nb == 1 ? b : b + s, nb == 1 ? 1 : e - s,
+                      out + s, e - s, op);
+    });
+}
+template <typename T, typename Cmp>
+std::size_t parallel_cmp(const T* a, std::size_t na, const T* b, std::size_t nb,
+                         T* out, std::size_t n, Cmp cmp) {
+    return parallel_reduce<std::size_t> (n,
+        [=] (std::size_t s, std::size_t e) {
+            return cmp_kernel (na == 1 ? a : a + s, na == 1 ? 1 : e - s,
+                               nb == 1 ? b : b + s, nb == 1 ? 1 : e - s,
+                               out + s, e - s, cmp);
+        },
+        [] (const std::size_t* p, std::size_t k) {
+            std::size_t c = 0;
+            for (std::size_t i = 0; i < k; ++i) c += p[i];
+            return c;
+        });
+}
+
+template <typename T>
+T parallel_sum(const T* x, std::size_t n) {
+    return parallel_reduce<T> (n,
+        [x] (std::size_t b, std::size_t e) { return pairwise_sum (x + b, e - b); },
+        [] (const T* p, std::size_t k) { return pairwise_sum (p, k); });
+}
+template <typename T>
+T parallel_dot(const T* a, const T* b, std::size_t n) {
+    return parallel_reduce<T> (n,
+        [a, b] (std::size_t s, std::size_t e) { return pairwise_dot (a + s, b + s, e - s); },
+        [] (const T* p, std::size_t k) { return pairwise_sum (p, k); });
+}
+template <typename T>
+T parallel_sqdev(const T* x, std::size_t n, T mu) {
+    return parallel_reduce<T> (n,
+        [x, mu] (std::size_t b, std::size_t e) { return pairwise_sqdev (x + b, e - b, mu); },
+        [] (const T* p, std::size_t k) { return pairwise_sum (p, k); });
+}
+template <typename T>
+T parallel_min(const T* x, std::size_t n) {
+    return parallel_reduce<T> (n,
+        [x] (std::size_t b, std::size_t e) { return min_kernel (x + b, e - b); },
+        [] (const T* p, std::size_t k) { return min_kernel (p, k); });
+}
+template <typename T>
+T parallel_max(const T* x, std::size_t n) {
+    return parallel_reduce<T> (n,
+        [x] (std::size_t b, std::size_t e) { return max_kernel (x + b, e - b); },
+        [] (const T* p, std::size_t k) { return max_kernel (p, k); });
+}
+
+#endif // PARALLEL_H
+
+// eof
@@ -70,12 +70,32 @@ Matrix<Real> list2matrix(AtomPtr l) {
     return m;
 }
 
+// row-parallel product (i-k-j order, rows split across the thread pool)
+Matrix<Real> matmul(const Matrix<Real>& a, const Matrix<Real>& b) {
+    const std::size_t n = a.rows(), m = a.cols(), p = b.cols();
+    Matrix<Real> c(n, p);
+    std::size_t chunks = parallel_chunks(n * m * p);
+    if (chunks > n) chunks = n;
+    parallel_for(n, chunks, [&](std::size_t, std::size_t r0, std::size_t r1) {
+        for (std::size_t i = r0; i < r1; ++i) {
+            Real* ci = c[i];
+            for (std::size_t k = 0; k < m; ++k) {
+                const Real aik = a(i, k);
+                const Real* bk = b[k];
+                MUSIL_SIMD
+                for (std::size_t j = 0; j < p; ++j) ci[j] += aik * bk[j];
+            }
+        }
+    }, 1);
+    return c;
+}
+
 // basic linear algebra: matmul, matsub, hadamard, transpose, shape
 AtomPtr fn_matdisp(AtomPtr node, AtomPtr env) {
     for (unsigned i = 0; i < node->tail.size(); ++i) {
         AtomPtr lmatrix = type_check(node->tail.at(i), LIST);
         Matrix<Real> m = list2matrix(lmatrix);
-        m.print(std::cout) << std::endl;
+        m.print(output()) << std::endl;
     }
     // Return the empty string just as a sentinel "unit" value
     return make_atom("");
@@ -97,9 +117,20 @@ AtomPtr name(AtomPtr node, AtomPtr env) { \
 }
 
 MAKE_MATBINOP (+, fn_matadd, "matadd");
-MAKE_MATBINOP (*, fn_matmul, "matmul");
 MAKE_MATBINOP (-, fn_matsub, "matsub");
 
+AtomPtr fn_matmul(AtomPtr node, AtomPtr env) {
+    Matrix<Real> a = list2matrix(type_check(node->tail.at(0), LIST));
+    for (unsigned i = 1; i < node->tail.size(); ++i) {
+        Matrix<Real> b = list2matrix(type_check(node->tail.at(i), LIST));
+        if (a.cols() != b.rows()) {
+            error("[matmul] nonconformant arguments", node);
+        }
+        a = matmul(a, b);
+    }
+    return matrix2list(a);
+}
+
 AtomPtr fn_hadamard(AtomPtr node, AtomPtr env) {// Element-wise product: hadamard / .*
     if (node->tail.size() < 2) {
         error("[hadamard] at least two matrices required", node);
@@ -135,7 +166,7 @@ AtomPtr fn_ncols(AtomPtr node, AtomPtr env) {
 }
 AtomPtr fn_matsum(AtomPtr node, AtomPtr env) {
     Matrix<Real> a = list2matrix(type_check(node->tail.at(0), LIST));
-    int axis = (int)type_check(node->tail.at(1), ARRAY)->array[0];
+    int axis = (int)scalar_check(node->tail.at(1));
 
     if (axis != 0 && axis != 1) {
         error("[matsum] axis must be 0 (columns) or 1 (rows)", node);
@@ -147,8 +178,8 @@ AtomPtr fn_matsum(AtomPtr node, AtomPtr env) {
 template <int MODE>
 AtomPtr fn_matget(AtomPtr node, AtomPtr env) {
     Matrix<Real> a = list2matrix(type_check(node->tail.at(0), LIST));
-    int start = (int)type_check(node->tail.at(1), ARRAY)->array[0];
-    int end   = (int)type_check(node->tail.at(2), ARRAY)->array[0];
+    int start = (int)scalar_check(node->tail.at(1));
+    int end   = (int)scalar_check(node->tail.at(2));
 
     Matrix<Real> b(1, 1);
 
@@ -169,7 +200,7 @@ AtomPtr fn_matget(AtomPtr node, AtomPtr env) {
 }
 
 AtomPtr fn_eye(AtomPtr node, AtomPtr env) {
-    int n = (int)type_check(node->tail.at(0), ARRAY)->array[0];
+    int n = (int)scalar_check(node->tail.at(0));
     if (n <= 0) {
         error("[eye] size must be positive", node);
     }
@@ -183,15 +214,13 @@ AtomPtr fn_rand(AtomPtr node, AtomPtr env) {
     if (nargs < 1 || nargs > 2) {
         error("[rand] expects 1 or 2 numeric arguments", node);
     }
-    AtomPtr len_atom = type_check(node->tail.at(0), ARRAY);
-    int len = static_cast<int>(len_atom->array[0]);
+    int len = static_cast<int>(scalar_check(node->tail.at(0)));
     if (len <= 0) {
         error("[rand] length must be positive", node);
     }
     int rows = 1;
     if (nargs == 2) {
-        AtomPtr rows_atom = type_check(node->tail.at(1), ARRAY);
-        rows = static_cast<int>(rows_atom->array[0]);
+        rows = static_cast<int>(scalar_check(node->tail.at(1)));
         if (rows <= 0) {
             error("[rand] number of rows must be positive", node);
         }
@@ -223,9 +252,9 @@ AtomPtr fn_bpf(AtomPtr node, AtomPtr env) {
     }
 
     // First segment: init, len0, end0
-    Real init = type_check(node->tail.at(0), ARRAY)->array[0];
-    int  len0 = static_cast<int>(type_check(node->tail.at(1), ARRAY)->array[0]);
-    Real end0 = type_check(node->tail.at(2), ARRAY)->array[0];
+    Real init = scalar_check(node->tail.at(0));
+    int  len0 = static_cast<int>(scalar_check(node->tail.at(1)));
+    Real end0 = scalar_check(node->tail.at(2));
 
     if (len0 <= 0) {
         error("[bpf] segment length must be positive", node);
@@ -246,11 +275,8 @@ AtomPtr fn_bpf(AtomPtr node, AtomPtr env) {
     for (std::size_t i = 0; i < n_extra; ++i) {
         // Index into the tail after the first 3 args:
         // arg index = 3 + 2*i (len) and 3 + 2*i + 1 (end)
-        AtomPtr len_atom = type_check(node->tail.at(3 + 2 * i), ARRAY);
-        AtomPtr end_atom = type_check(node->tail.at(3 + 2 * i + 1), ARRAY);
-
-        int  seg_len  = static_cast<int>(len_atom->array[0]);
-        Real seg_end  = end_atom->array[0];
+        int  seg_len  = static_cast<int>(scalar_check(node->tail.at(3 + 2 * i)));
+        Real seg_end  = scalar_check(node->tail.at(3 + 2 * i + 1));
 
         if (seg_len <= 0) {
             error("[bpf] segment length must be positive", node);
@@ -284,7 +310,8 @@ AtomPtr fn_diag(AtomPtr node, AtomPtr env) { // diag: ARRAY -> diagonal matrix,
     AtomPtr arg = node->tail.at(0);
 
     if (arg->type == ARRAY) {
-        std::valarray<Real>& v = arg->array;
+        AtomPtr va = type_check(arg, ARRAY);
+        std::valarray<Real>& v = va->array;
         const std::size_t n = v.size();
         Matrix<Real> m(n, n);
         for (std::size_t i = 0; i < n; ++i) {
@@ -356,7 +383,8 @@ AtomPtr fn_rank(AtomPtr node, AtomPtr env) { // Simple Gaussian-elimination-base
 }
 AtomPtr fn_solve(AtomPtr node, AtomPtr env) { // solve Ax = b for square A and vector b (single RHS)
     Matrix<Real> A = list2matrix(type_check(node->tail.at(0), LIST));
-    std::valarray<Real>& b = type_check(node->tail.at(1), ARRAY)->array;
+    AtomPtr ba = type_check(node->tail.at(1), ARRAY);
+    std::valarray<Real>& b = ba->array;
 
     const std::size_t n = A.rows();
     if (A.cols() != n) {
@@ -425,12 +453,12 @@ AtomPtr fn_matcol(AtomPtr node, AtomPtr env) {
     }
 
     Matrix<Real> a = list2matrix(type_check(node->tail.at(0), LIST));
-    std::valarray<Real>& idx_arr = type_check(node->tail.at(1), ARRAY)->array;
-    if (idx_arr.size() < 1) {
+    AtomPtr idx = type_check(node->tail.at(1), ARRAY);
+    if (array_size(idx) < 1) {
         error("[matcol] column index must be a scalar array", node);
     }
 
-    int col = static_cast<int>(idx_arr[0]);
+    int col = static_cast<int>(scalar_check(idx));
     if (col < 0 || col >= static_cast<int>(a.cols())) {
         error("[matcol] column index out of range", node);
     }
@@ -450,8 +478,10 @@ AtomPtr fn_stack2(AtomPtr node, AtomPtr env) {
         error("[stack2] expects two arrays x and y", node);
     }
 
-    std::valarray<Real>& x = type_check(node->tail.at(0), ARRAY)->array;
-    std::valarray<Real>& y = type_check(node->tail.at(1), ARRAY)->array;
+    AtomPtr xa = type_check(node->tail.at(0), ARRAY);
+    AtomPtr ya = type_check(node->tail.at(1), ARRAY);
+    std::valarray<Real>& x = xa->array;
+    std::valarray<Real>& y = ya->array;
 
     if (x.size() != y.size()) {
         error("[stack2] x and y must have the same length", node);
@@ -470,8 +500,9 @@ AtomPtr fn_stack2(AtomPtr node, AtomPtr env) {
 
 // simple statistics
 AtomPtr fn_median(AtomPtr node, AtomPtr env) {
-    std::valarray<Real>& v = type_check(node->tail.at(0), ARRAY)->array;
-    int order = (int)type_check(node->tail.at(1), ARRAY)->array[0];
+    AtomPtr va = type_check(node->tail.at(0), ARRAY);
+    std::valarray<Real>& v = va->array;
+    int order = (int)scalar_check(node->tail.at(1));
 
     if (order <= 0) {
         error("[median] order must be positive", node);
@@ -504,8 +535,10 @@ AtomPtr fn_median(AtomPtr node, AtomPtr env) {
     return make_atom(out);
 }
 AtomPtr fn_linefit(AtomPtr node, AtomPtr env) {
-    std::valarray<Real>& x = type_check(node->tail.at(0), ARRAY)->array;
-    std::valarray<Real>& y = type_check(node->tail.at(1), ARRAY)->array;
+    AtomPtr xa = type_check(node->tail.at(0), ARRAY);
+    AtomPtr ya = type_check(node->tail.at(1), ARRAY);
+    std::valarray<Real>& x = xa->array;
+    std::valarray<Real>& y = ya->array;
     if (x.size() != y.size()) {
         error("[linefit] x and y must have the same size", node);
     }
@@ -522,7 +555,7 @@ AtomPtr fn_linefit(AtomPtr node, AtomPtr env) {
 }
 AtomPtr fn_matmean(AtomPtr node, AtomPtr env) { // Matrix mean along axis -> ARRAY
     Matrix<Real> a = list2matrix(type_check(node->tail.at(0), LIST));
-    int axis = (int)type_check(node->tail.at(1), ARRAY)->array[0];
+    int axis = (int)scalar_check(node->tail.at(1));
 
     const std::size_t rows = a.rows();
     const std::size_t cols = a.cols();
@@ -560,7 +593,7 @@ AtomPtr fn_matmean(AtomPtr node, AtomPtr env) { // Matrix mean along axis -> ARR
 }
 AtomPtr fn_matstd(AtomPtr node, AtomPtr env) { // Matrix std along axis -> ARRAY
     Matrix<Real> a = list2matrix(type_check(node->tail.at(0), LIST));
-    int axis = (int)type_check(node->tail.at(1), ARRAY)->array[0];
+    int axis = (int)scalar_check(node->tail.at(1));
 
     const std::size_t rows = a.rows();
     const std::size_t cols = a.cols();
@@ -755,7 +788,7 @@ AtomPtr fn_kmeans(AtomPtr node, AtomPtr env) {
     }
 
     int K = static_cast<int>(
-        type_check(node->tail.at(1), ARRAY)->array[0]
+        scalar_check(node->tail.at(1))
     );
 
     const int n = static_cast<int>(X.rows());
@@ -820,12 +853,11 @@ AtomPtr fn_knn(AtomPtr node, AtomPtr env) {
     }
 
     // 2) k
-    std::valarray<Real>& karr =
-        type_check(node->tail.at(1), ARRAY)->array;
-    if (karr.size() < 1) {
+    AtomPtr ka = type_check(node->tail.at(1), ARRAY);
+    if (array_size(ka) < 1) {
         error("[knn] k must be a scalar array", node);
     }
-    int K = static_cast<int>(karr[0]);
+    int K = static_cast<int>(scalar_check(ka));
     if (K < 1 || K > obs) {
         error("[knn] invalid K parameter", node);
     }
@@ -838,8 +870,8 @@ AtomPtr fn_knn(AtomPtr node, AtomPtr env) {
     if (first_item->tail.size() != 2) {
         error("[knn] each training item must be (features label)", node);
     }
-    std::valarray<Real>& first_feat =
-        type_check(first_item->tail.at(0), ARRAY)->array;
+    AtomPtr fa = type_check(first_item->tail.at(0), ARRAY);
+    std::valarray<Real>& first_feat = fa->array;
     int features = static_cast<int>(first_feat.size());
     if (features < 1) {
         error("[knn] invalid number of features", node);
@@ -12,6 +12,9 @@
 #include <functional>
 #include <chrono>
 #include <future>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 #include <iostream>
 #include <stdexcept>
 #include <sys/types.h>
@@ -61,38 +64,150 @@ void save_env_paths (AtomPtr env) {
 }
 
 // system functions
-AtomPtr fn_schedule(AtomPtr node, AtomPtr env) {
+// time: steady_clock nanoseconds as Real (exact for about 100 days of uptime)
+inline Real now_ns () {
+    return (Real) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Scheduler::Clock::now().time_since_epoch()).count();
+}
+inline Scheduler::Clock::time_point ns_to_time (Real ns) {
+    return Scheduler::Clock::time_point(std::chrono::duration_cast<Scheduler::Clock::duration>(
+        std::chrono::nanoseconds((long long) ns)));
+}
+// blocking primitives wake up every few ms on threads that can be stopped
+// (g_cancel), so that a stopped isolate leaves them
+const std::chrono::milliseconds CANCEL_SLICE (20);
+void sleep_until_cancellable (Scheduler::Clock::time_point t) {
+    if (!g_cancel) {
+        std::this_thread::sleep_until(t);
+        return;
+    }
+    for (auto now = Scheduler::Clock::now(); now < t; now = Scheduler::Clock::now()) {
+        check_cancel();
+        std::this_thread::sleep_until(std::min(t, now + CANCEL_SLICE));
+    }
+}
+template <typename Pred>
+bool wait_cancellable (std::condition_variable& cv, std::unique_lock<std::mutex>& g,
+    Scheduler::Clock::time_point deadline, Pred pred) { // false on timeout
+    while (!pred()) {
+        check_cancel();
+        auto now = Scheduler::Clock::now();
+        if (now >= deadline) return false;
+        if (g_cancel) cv.wait_until(g, std::min(deadline, now + CANCEL_SLICE));
+        else if (deadline == Scheduler::Clock::time_point::max()) cv.wait(g);
+        else cv.wait_until(g, deadline);
+    }
+    return true;
+}
+// tempo clocks map beats to absolute times from a fixed origin, so events
+// placed on beats do not accumulate the drift of chained relative delays
+struct TempoClock : Native {
+    std::mutex lock;
+    Real origin;      // ns at beat 0
+    Real bpm;
+    Real swing = 0;   // delay of the off-beat eighth, in [0, 1) of an eighth
+    Real beat_ns () const { return 60e9 / bpm; }
+    Real time_of (Real beat) { // ns
+        std::lock_guard<std::mutex> g (lock);
+        Real w = std::floor(beat), f = beat - w;
+        if (swing > 0) f = f < .5 ? f * (1 + swing) : .5 * (1 + swing) + (f - .5) * (1 - swing);
+        return origin + (w + f) * beat_ns ();
+    }
+    Real beat_at (Real ns) { // unswung beat position
+        std::lock_guard<std::mutex> g (lock);
+        return (ns - origin) / beat_ns ();
+    }
+    void set_bpm (Real b, Real at) { // keeps the beat position at time at
+        std::lock_guard<std::mutex> g (lock);
+        Real beat = (at - origin) / beat_ns ();
+        bpm = b;
+        origin = at - beat * beat_ns ();
+    }
+};
+struct ScheduledEvent : Native {
+    std::uint64_t id;
+    explicit ScheduledEvent (std::uint64_t i) : id (i) {}
+};
+// thunks run one at a time on the scheduler thread (see core/Scheduler.h)
+AtomPtr fn_schedule(AtomPtr node, AtomPtr env) { // (%schedule thunk delay [tempo]) -> event handle
     args_check(node, 2);
     AtomPtr thunk     = type_check(node->tail.at(0), LAMBDA);
-    AtomPtr delayAtom = type_check(node->tail.at(1), ARRAY);
-    int delay_ms      = static_cast<int>(delayAtom->array[0]);
-    AtomPtr thunk_clone = clone(thunk);
-    AtomPtr env_clone   = clone(env);
-    std::thread([thunk_clone, env_clone, delay_ms]() {
+    Real delay = scalar_check(node->tail.at(1));
+    Scheduler::Clock::time_point due;
+    if (node->tail.size() > 2) { // delay is a beat of the tempo clock
+        TempoClock* tc = native_check<TempoClock>(node->tail.at(2), "tempo");
+        due = ns_to_time(tc->time_of(delay));
+    } else {
+        Real delay_ms = std::max<Real>(0, delay);
+        due = Scheduler::Clock::now() +
+            std::chrono::duration_cast<Scheduler::Clock::duration>(std::chrono::duration<Real, std::milli>(delay_ms));
+    }
+    AtomPtr event = detach_function(thunk); // runs in its own fork, see snapshot_env
+    std::uint64_t id = Scheduler::instance().post(due, [event]() {
         try {
-            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
             AtomPtr call = make_atom();
-            call->tail.push_back(thunk_clone);
-            eval(call, env_clone);
+            call->tail.push_back(event);
+            ForkScope fork(event->tail.at(2));
+            eval(call, event->tail.at(2));
+            flush_output();
         } catch (const std::exception& e) {
             std::cerr << "[schedule] error: " << e.what() << std::endl;
         } catch (...) {
             std::cerr << "[schedule] unknown error" << std::endl;
         }
-    }).detach();
-    return make_atom();
+    });
+    return make_native("event", std::make_shared<ScheduledEvent>(id));
+}
+AtomPtr fn_cancel(AtomPtr node, AtomPtr env) { // (cancel event) -> 1 if it had not started yet
+    ScheduledEvent* e = native_check<ScheduledEvent>(node->tail.at(0), "event");
+    return make_atom((Real) Scheduler::instance().cancel(e->id));
 }
 AtomPtr fn_sleep(AtomPtr params, AtomPtr env) {
-    std::valarray<Real>& a = type_check(params->tail.at(0), ARRAY)->array;
-    int delay_ms = static_cast<int>(a[0]);
+    int delay_ms = static_cast<int>(scalar_check(params->tail.at(0)));
+    flush_output();
     if (delay_ms > 0) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        sleep_until_cancellable(Scheduler::Clock::now() + std::chrono::milliseconds(delay_ms));
     }
     return make_atom(); // ()
 }
-AtomPtr fn_clock (AtomPtr params, AtomPtr env) {
+AtomPtr fn_sleep_until(AtomPtr params, AtomPtr env) { // (sleep-until ns)
+    Real t = scalar_check(params->tail.at(0));
+    flush_output();
+    const Real spin = 200e3; // ns: the last stretch is spent yielding, not sleeping
+    if (t - now_ns() > spin) sleep_until_cancellable(ns_to_time(t - spin));
+    while (now_ns() < t) std::this_thread::yield();
+    return make_atom();
+}
+AtomPtr fn_clock (AtomPtr params, AtomPtr env) { // CPU time, see now for wall time
     return make_atom (clock ());
 }
+AtomPtr fn_now (AtomPtr params, AtomPtr env) { // monotonic wall time in ns
+    return make_atom (now_ns ());
+}
+AtomPtr fn_tempo (AtomPtr params, AtomPtr env) { // (tempo bpm [swing]) -> clock starting at beat 0 now
+    std::shared_ptr<TempoClock> tc = std::make_shared<TempoClock>();
+    tc->bpm = scalar_check(params->tail.at(0));
+    if (params->tail.size() > 1) tc->swing = scalar_check(params->tail.at(1));
+    if (tc->bpm <= 0 || tc->swing < 0 || tc->swing >= 1) error("[tempo] invalid bpm or swing", params);
+    tc->origin = now_ns();
+    return make_native("tempo", tc);
+}
+AtomPtr fn_setbpm (AtomPtr params, AtomPtr env) { // (setbpm clock bpm), the current beat is kept
+    TempoClock* tc = native_check<TempoClock>(params->tail.at(0), "tempo");
+    Real bpm = scalar_check(params->tail.at(1));
+    if (bpm <= 0) error("[setbpm] invalid bpm", params);
+    tc->set_bpm(bpm, now_ns());
+    return make_atom(bpm);
+}
+AtomPtr fn_beat2time (AtomPtr params, AtomPtr env) { // (beat->time clock beat) -> ns, with swing
+    TempoClock* tc = native_check<TempoClock>(params->tail.at(0), "tempo");
+    return make_atom(tc->time_of(scalar_check(params->tail.at(1))));
+}
+AtomPtr fn_time2beat (AtomPtr params, AtomPtr env) { // (time->beat clock [ns]) -> beat, now by default
+    TempoClock* tc = native_check<TempoClock>(params->tail.at(0), "tempo");
+    Real t = params->tail.size() > 1 ? scalar_check(params->tail.at(1)) : now_ns();
+    return make_atom(tc->beat_at(t));
+}
 AtomPtr fn_dirlist (AtomPtr params, AtomPtr env) {
     std::string path = type_check (params->tail.at (0), STRING)->lexeme;
     DIR *dir;
@@ -100,7 +215,7 @@ AtomPtr fn_dirlist (AtomPtr params, AtomPtr env) {
     struct dirent *ent;
     if ((dir = opendir (path.c_str())) != NULL) {
         while ((ent = readdir (dir)) != NULL) {
-            ll->tail.push_back (make_atom ((std::string) "\"" + ent->d_name));
+            ll->tail.push_back (make_string (ent->d_name));
         }
         closedir (dir);
     }
@@ -127,12 +242,12 @@ AtomPtr fn_filestat (AtomPtr params, AtomPtr env) {
     tt << ((fileStat.st_mode & S_IROTH) ? "r" : "-");
     tt << ((fileStat.st_mode & S_IWOTH) ? "w" : "-");
     tt << ((fileStat.st_mode & S_IXOTH) ? "x" : "-");
-    ll->tail.push_back(make_atom((std::string) "\"" + tt.str ().c_str ()));
+    ll->tail.push_back(make_string (tt.str ()));
     return ll;
 }
 AtomPtr fn_getvar (AtomPtr params, AtomPtr env) {
     char* c = getenv (type_check (params->tail.at (0), STRING)->lexeme.c_str ());
-    if (c) return make_atom ((std::string) "\"" + (std::string) c);
+    if (c) return make_string (c);
     else return make_atom("");
 }
 AtomPtr fn_addpaths (AtomPtr params, AtomPtr env) {
@@ -180,7 +295,7 @@ AtomPtr fn_udprecv (AtomPtr n, AtomPtr env) {
 
     server.sin_addr.s_addr = inet_addr(type_check (n->tail.at(0), STRING)->lexeme.c_str ());
     server.sin_family = AF_INET;
-    server.sin_port = htons((long)type_check (n->tail.at(1), ARRAY)->array[0]);
+    server.sin_port = htons((long)scalar_check (n->tail.at(1)));
 
 if(::bind(sock,(struct sockaddr *)&server , sizeof(server)) < 0) {
         return make_atom(0);
@@ -192,7 +307,7 @@ if(::bind(sock,(struct sockaddr *)&server , sizeof(server)) < 0) {
     }
 
     ::close (sock);
-    return make_atom ((std::string) "\"" + client_message);
+    return make_string (client_message);
 }
 class OSCstring {
 public:
@@ -238,9 +353,9 @@ AtomPtr fn_udpsend (AtomPtr n, AtomPtr env) {
     
     server.sin_addr.s_addr = inet_addr(type_check (n->tail.at (0), STRING)->lexeme.c_str ());
     server.sin_family = AF_INET;
-    server.sin_port = htons((long)type_check (n->tail.at(1), ARRAY)->array[0]);
+    server.sin_port = htons((long)scalar_check (n->tail.at(1)));
     bool is_osc = false;
-    if (n->tail.size () == 4) is_osc = (bool) type_check (n->tail.at (3), ARRAY)->array[0];
+    if (n->tail.size () == 4) is_osc = (bool) scalar_check (n->tail.at (3));
 
     std::stringstream nf;
     print (n->tail.at(2), nf);
@@ -258,11 +373,169 @@ AtomPtr fn_udpsend (AtomPtr n, AtomPtr env) {
     return  make_atom (1);
 }
 
+// isolates: interpreters running on their own thread, in a fork of a frozen
+// snapshot of the environment they are created from (see snapshot_env), so
+// that isolates created from the same environment share one copy of it. They
+// share no mutable state and exchange values through channels; arrays are
+// passed by reference and frozen (see mutable_check) on both sides, other
+// values are copied.
+AtomPtr isolate_value (AtomPtr v, AtomPtr node) {
+    switch (v->type) {
+        case ARRAY:
+            v->frozen = true;
+            return v;
+        case REGEX: case OP: case NATIVE:
+            return v;
+        case STRING: case SYMBOL: {
+            AtomPtr r = make_atom ();
+            r->type = v->type;
+            r->lexeme = v->lexeme;
+            return r;
+        }
+        case LIST: {
+            AtomPtr r = make_atom ();
+            r->tail.reserve (v->tail.size ());
+            for (auto& e : v->tail) r->tail.push_back (isolate_value (e, node));
+            return r;
+        }
+        case DICT: {
+            AtomPtr r = make_atom ();
+            r->type = DICT;
+            r->dict () = std::make_shared<Dict> (*v->dict ());
+            for (auto& e : r->dict ()->entries) e.second = isolate_value (e.second, node);
+            return r;
+        }
+        default:
+            error ("[isolate] functions cannot be passed between isolates", node);
+    }
+    return make_atom (); // dummy
+}
+struct Channel : Native {
+    std::mutex lock;
+    std::condition_variable ready, space;
+    std::deque<AtomPtr> items;
+    std::size_t capacity = 0; // 0 = unbounded
+    int type = -1; // required AtomType, -1 = any
+    bool closed = false;
+};
+struct Isolate : Native {
+    struct State {
+        AtomPtr result;
+        std::string failure;
+        std::atomic<bool> stop {false}; // see g_cancel
+    };
+    std::thread thread;
+    std::shared_ptr<State> state = std::make_shared<State> ();
+    std::mutex join_lock;
+    ~Isolate () { // last handle dropped: the result is lost, stop the thread
+        state->stop = true;
+        if (thread.joinable ()) thread.join ();
+    }
+};
+AtomPtr fn_isolate (AtomPtr node, AtomPtr env) { // (isolate f args...) -> handle
+    AtomPtr f = type_check (node->tail.at (0), LAMBDA);
+    AtomPtr args = make_atom ();
+    for (unsigned i = 1; i < node->tail.size (); ++i) args->tail.push_back (isolate_value (node->tail.at (i), node));
+    AtomPtr func = detach_function (f);
+    AtomPtr ienv = func->tail.at (2);
+    std::shared_ptr<Isolate> iso = std::make_shared<Isolate> ();
+    std::shared_ptr<Isolate::State> state = iso->state;
+    iso->thread = std::thread ([state, func, args, ienv] () {
+        g_cancel = &state->stop;
+        ForkScope fork (ienv);
+        try {
+            state->result = apply_function (func, args, ienv);
+        } catch (std::exception& e) {
+            state->failure = e.what ();
+        } catch (...) {
+            state->failure = "unknown error";
+        }
+        flush_output ();
+    });
+    return make_native ("isolate", iso);
+}
+AtomPtr fn_join (AtomPtr node, AtomPtr env) { // (join isolate) -> result of its function
+    Isolate* iso = native_check<Isolate> (node->tail.at (0), "isolate");
+    {
+        std::lock_guard<std::mutex> g (iso->join_lock);
+        if (iso->thread.joinable ()) iso->thread.join ();
+    }
+    if (iso->state->failure.size ()) error ("[isolate] " + iso->state->failure, node->tail.at (0));
+    return iso->state->result;
+}
+AtomPtr fn_channel (AtomPtr node, AtomPtr env) { // (channel ['type] [capacity])
+    std::shared_ptr<Channel> ch = std::make_shared<Channel> ();
+    for (unsigned i = 0; i < node->tail.size (); ++i) {
+        AtomPtr a = node->tail.at (i);
+        if (a->type == SYMBOL) {
+            auto t = std::find (std::begin (ATOM_NAMES), std::end (ATOM_NAMES), a->lexeme);
+            if (t == std::end (ATOM_NAMES)) error ("[channel] invalid type", a);
+            ch->type = (int) (t - std::begin (ATOM_NAMES));
+        } else {
+            Real c = scalar_check (a);
+            if (c < 0) error ("[channel] invalid capacity", a);
+            ch->capacity = (std::size_t) c;
+        }
+    }
+    return make_native ("channel", ch);
+}
+AtomPtr fn_send (AtomPtr node, AtomPtr env) { // (send ch x), blocks while the channel is full
+    Channel* ch = native_check<Channel> (node->tail.at (0), "channel");
+    AtomPtr v = node->tail.at (1);
+    if (ch->type >= 0) type_check (v, (AtomType) ch->type);
+    v = isolate_value (v, node);
+    std::unique_lock<std::mutex> g (ch->lock);
+    wait_cancellable (ch->space, g, Scheduler::Clock::time_point::max (),
+        [ch] { return ch->closed || !ch->capacity || ch->items.size () < ch->capacity; });
+    if (ch->closed) error ("[send] channel is closed", node->tail.at (0));
+    ch->items.push_back (v);
+    ch->ready.notify_one ();
+    return make_atom (1);
+}
+AtomPtr fn_recv (AtomPtr node, AtomPtr env) { // (recv ch [timeout]) -> value, () if closed or timed out
+    Channel* ch = native_check<Channel> (node->tail.at (0), "channel");
+    std::unique_lock<std::mutex> g (ch->lock);
+    auto has_data = [ch] { return ch->closed || ch->items.size (); };
+    Scheduler::Clock::time_point deadline = Scheduler::Clock::time_point::max ();
+    if (node->tail.size () > 1) {
+        Real ms = scalar_check (node->tail.at (1));
+        deadline = Scheduler::Clock::now () + std::chrono::duration_cast<Scheduler::Clock::duration> (
+            std::chrono::duration<Real, std::milli> (ms));
+    }
+    wait_cancellable (ch->ready, g, deadline, has_data);
+    if (ch->items.empty ()) return make_atom ();
+    AtomPtr v = ch->items.front ();
+    ch->items.pop_front ();
+    ch->space.notify_one ();
+    return v;
+}
+AtomPtr fn_close (AtomPtr node, AtomPtr env) { // (close ch): pending values can still be received
+    Channel* ch = native_check<Channel> (node->tail.at (0), "channel");
+    std::lock_guard<std::mutex> g (ch->lock);
+    ch->closed = true;
+    ch->ready.notify_all ();
+    ch->space.notify_all ();
+    return make_atom ();
+}
+
 // interface
 AtomPtr add_system (AtomPtr env) {
     add_op ("%schedule", &fn_schedule, 2, env);
+    add_op ("cancel", &fn_cancel, 1, env);
     add_op ("sleep",  &fn_sleep,   1, env);
+    add_op ("isolate", &fn_isolate, 1, env);
+    add_op ("join", &fn_join, 1, env);
+    add_op ("channel", &fn_channel, 0, env);
+    add_op ("send", &fn_send, 2, env);
+    add_op ("recv", &fn_recv, 1, env);
+    add_op ("close", &fn_close, 1, env);
+    add_op ("sleep-until", &fn_sleep_until, 1, env);
     add_op ("clock", &fn_clock, 0, env);
+    add_op ("now", &fn_now, 0, env);
+    add_op ("tempo", &fn_tempo, 1, env);
+    add_op ("setbpm", &fn_setbpm, 2, env);
+    add_op ("beat->time", &fn_beat2time, 2, env);
+    add_op ("time->beat", &fn_time2beat, 1, env);
     add_op ("dirlist", &fn_dirlist, 1, env);
     add_op ("filestat", &fn_filestat, 1, env);
     add_op ("getvar", &fn_getvar, 1, env);
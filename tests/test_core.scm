@@ -80,6 +80,24 @@
 (test '(< [1 2] [2 1]) [1 0])
 (test '(> [3 1] [2 1]) [1 0])
 
+;; scalar broadcast on either side
+(test '(< [1 2 3] [2])   [1 0 0])
+(test '(>= [2] [1 2 3])  [1 1 0])
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Masks: select, massign
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+(test '(select [1 0 1] [1 2 3] [4 5 6])         [1 5 3])
+(test '(select (> [1 -2 3] 0) [1 -2 3] 0)       [1 0 3])
+(test '(select [0] [1 2] [7 8])                 [7 8])
+
+(def mx [1 -2 3 -4])
+(massign mx (< mx 0) 0)
+(test 'mx [1 0 3 0])
+(massign mx [0 1 0 1] [9 8 7 6])
+(test 'mx [1 8 3 6])
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; Aggregates: min, max, sum, size
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -93,6 +111,32 @@
 (test '(max [5 4 9] [-1 10]) [9 10])
 (test '(sum [1 1]   [2 2])   [2 4])
 
+;; native reductions
+(test '(mean [1 2 3] [4 6])      [2 5])
+(test '(variance [1 2 3 4])      1.6666666667)
+(test '(variance [4])            0)
+(test '(norm [3 4] [6 8])        [5 10])
+(test '(dot [1 2 3] [2])         12)
+(test '(argmin [4 1 3 1])        1)
+(test '(argmax [4 9 3 9] [1 2])  [1 1])
+(test '(argmax (/ [0 0] 0))      0)
+
+;; chunked execution on the thread pool gives the same results
+(def big (rand 10000))
+(def big-sum (sum big))
+(def big-mask (> big 0))
+(def pool (threads))
+(threads 4 1000)
+(test '(info threads)            [4 1000])
+(test '(sum big)                 big-sum)
+(test '(> big 0)                 big-mask)
+(test '(sum (* big 2))           (* big-sum 2))
+(threads (getval pool 0) (getval pool 1))
+
+;; pairwise summation keeps long sums exact within the comparison epsilon
+(test '(sum (+ (* (rand 1000000) 0) 0.1)) 100000)
+(test '(mean (+ (* (rand 1000000) 0) 0.1)) 0.1)
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; Unary math: sin, cos, tan, log, exp, abs, neg, floor, etc.
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -233,6 +277,132 @@
 (test '(llength (lshuffle (list [1] [2] [3])))
       [3])
 
+;; long lists share their nodes: slices and updates do not leak
+(def long (array2list (bpf 0 1000 1000)))
+(def part (lrange long 100 500))
+(test '(llength part)            500)
+(test '(lindex part 0)           100)
+(lset part -1 0)
+(test '(lindex long 100)         100)
+(lappend part 7)
+(test '(lindex part 500)         7)
+(test '(llength long)            1000)
+(lreplace long (list -2 -3) 998 2)
+(test '(lrange long 997 3)       '(997 -2 -3))
+(test '(lindex part 499)         599)
+(test '(llength (lshuffle long))  1000)
+(test '(lindex (lreverse long) 0) -3)
+(test '(foldl + 0 (cdr (cdr long))) 497497)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Dictionaries: dict, dget, dset, dhas, ddel, dkeys
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+(def notes (dict "a4" 440 'c4 261.63 69 "midi"))
+(test '(dget notes "a4")         440)
+(test '(dget notes 'c4)          261.63)
+(test '(dget notes 69)           "midi")
+(test '(dget notes 'a4)          '())     ; symbols and strings are distinct keys
+(test '(dget notes 'b4 -1)       -1)
+(dset notes 'b4 493.88 'a4 [1 2])
+(test '(dhas notes 'b4)          1)
+(test '(dkeys notes)             '("a4" c4 69 b4 a4))
+(ddel notes "a4")
+(test '(dhas notes "a4")         0)
+(test '(dkeys notes)             '(a4 c4 69 b4))
+(test '(dget notes 'a4)          [1 2])
+(test '(info 'typeof notes)      '(dict))
+(test '(dict 1 '(x) 'k "v")      (dict 'k "v" 1 '(x)))
+(test '(== (dict 1 2) (dict 1 3)) 0)
+
+;; save writes a (dict ...) expression that rebuilds the dictionary
+(save "/tmp/musil_dict_test.txt" notes)
+(test '(eval (car (read "/tmp/musil_dict_test.txt"))) notes)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Structural hash and memoization
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;; equal atoms hash equally; Reals are compared on a 1e-6 grid
+(test '(== (hash '(1 "a" b)) (hash (list 1 "a" 'b))) 1)
+(test '(== (hash [1 2]) (hash [1.0000001 2]))        1)
+(test '(== (hash [1 2]) (hash [1 2.1]))              0)
+(test '(== (hash "a") (hash 'a))                     0)
+(test '(== (hash (dict 1 2 'k 3)) (hash (dict 'k 3 1 2))) 1)
+
+(def memo-calls 0)
+(def mul (memo (lambda (x y) { (= memo-calls (+ memo-calls 1)) (* x y) })))
+(test '(mul 3 4)                 12)
+(test '(mul 3 4)                 12)
+(test '(mul [1 2] 2)             [2 4])
+(test 'memo-calls                2)
+(test '(getval (info 'memo mul) 0) 1)    ; hits
+(test '(getval (info 'memo mul) 1) 2)    ; misses
+(test '((mul 5) 2)               10)
+
+;; entries larger than the byte budget are not kept
+(def tiny (memo (lambda (n) (* (rand n) 0)) 100))
+(tiny 1000)
+(test '(getval (info 'memo tiny) 2) 0)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; float32 arrays
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+(def a32 (f32 [1 2 3 4]))
+(test '(dtype a32)               'f32)
+(test '(dtype [1 2])             'f64)
+(test 'a32                       [1 2 3 4])
+(test '(dtype (+ a32 1))         'f32)    ; scalars keep f32
+(test '(dtype (* a32 a32))       'f32)
+(test '(dtype (+ a32 [1 1 1 1])) 'f64)    ; f64 arrays promote
+(test '(+ a32 [1 1 1 1])         [2 3 4 5])
+(test '(dtype (sqrt a32))        'f32)
+(test '(size a32)                4)
+(test '(sum a32)                 10)
+(test '(mean a32)                2.5)
+(test '(argmax a32)              3)
+(test '(dot a32 a32)             30)
+(test '(slice a32 1 2)           [2 3])
+(test '(select (> a32 2) a32 0)  [0 0 3 4])
+(test '(dtype (f64 a32))         'f64)
+(test '(== (hash a32) (hash [1 2 3 4])) 1)
+(test '(lindex (array2list (f32 [0.5 2])) 0) 0.5)
+(test '(if a32 (dtype a32) 0)      'f32)    ; read-only uses keep the storage
+(test '(dtype a32)               'f32)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Isolates and channels
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+(def iso-in (channel 'array 2))
+(def iso-out (channel))
+(def iso-global 1)
+(function iso-sum () {
+  (def acc 0)
+  (def x (recv iso-in))
+  (while (eq (info 'typeof x) '(array)) {
+    (= acc (+ acc (sum x)))
+    (= x (recv iso-in))
+  })
+  (send iso-out (list "sum" acc))
+  (= iso-global 2)                       ; copied into the isolate's fork
+  acc
+})
+(def iso (isolate iso-sum))
+(send iso-in [1 2 3])
+(send iso-in [4])
+(close iso-in)
+(test '(recv iso-out)                    '("sum" 10))
+(test '(join iso)                        10)
+(test 'iso-global                        1)
+(test '(recv iso-out 1)                  '())     ; timeout
+(test '(join (isolate (lambda (a b) (+ a b)) 2 3)) 5)
+(test '(join (isolate (lambda () iso-global))) 1)   ; the snapshot is unchanged
+(def iso-stuck (isolate (lambda () (recv (channel)))))
+(= iso-stuck ())                                     ; dropping the handle stops it
+(test '(+ 1 1) 2)
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; array2list
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -458,6 +628,43 @@
 ;; regex (simple match of digits)
 (test '(llength (str 'regex "abc123" "[0-9]+")) [1])
 
+;; string building
+(def sb (strbuild))
+(strbuild sb "f=" 440 " " 'hz)
+(test 'sb                                   "f=440 hz")
+(test '(strbuild (strbuild) "a" [1 2])      "a[1 2]")
+(function sb-tag (x) (strbuild "id:" x))            ; literals are copied, not appended to
+(sb-tag 1)
+(test '(sb-tag 2)                           "id:2")
+(test '(strjoin '("a" b 3) ",")             "a,b,3")
+(test '(strjoin (list "x" "y"))             "xy")
+(test '(llength (str 'split "a,,b," ","))   3)
+(test '(str 'range "hello" 2 100)           "llo")
+
+;; number formatting
+(test '(tostr [1 0.1 1000000 123456789]) "[1 0.1 1e+06 1.23457e+08]")
+(test '(precision)                          6)
+(precision 0)                               ; shortest exact form
+(test '(tostr 3.14159265358979)             "3.14159265358979")
+(precision 6)
+(test '(tostr 3.14159265358979)             "3.14159")
+
+;; compiled regex atoms
+(def kv (regex "([a-z]+)=([0-9]+)"))
+(test '(str 'regex "a=1 b=22" kv)          '("a=1" "a" "1"))
+(test '(str 'regex "a=1 b=22" "b=([0-9]+)") '("b=22" "22"))
+(test '(llength (str 'match-all "a=1 b=22 c=3" kv)) 3)
+(test '(lindex (str 'match-all "a=1 b=22" "[0-9]+") 1) '("22"))
+(test '(str 'match-all "abc" "[0-9]")       '())
+(test '(eq kv (regex "([a-z]+)=([0-9]+)"))  1)
+;; save writes patterns and strings escaped, read gives them back
+(def re-esc (regex "\\d+\"?"))
+(save "/tmp/musil_regex_test.txt" re-esc)
+(test '(eq (eval (car (read "/tmp/musil_regex_test.txt"))) re-esc) 1)
+(test '(str 'regex "x 12\"" re-esc)        '("12\""))
+(save "/tmp/musil_string_test.txt" "a\"b\\c\n")
+(test '(car (read "/tmp/musil_string_test.txt")) "a\"b\\c\n")
+
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; Macro tests: function, let, when, unless, schedule
@@ -560,6 +767,115 @@
 ;; better tested manually or with a more elaborate harness.
 (test '(info 'typeof schedule) '(macro))
 
+;; events can be cancelled until they run
+(def sched-ev (schedule (lambda () ()) 10000))
+(test '(info 'typeof sched-ev)  '(native))
+(test '(cancel sched-ev)        1)
+(test '(cancel sched-ev)        0)
+(test '(getval (info 'scheduler) 2) 1)  ; cancelled so far
+
+;; events run in their own fork of a shared snapshot of the environment
+(def sched-out (channel))
+(def sched-x 1)
+(schedule (lambda () { (= sched-x 2) (send sched-out sched-x) }) 1)
+(test '(recv sched-out 2000)    2)
+(schedule (lambda () (send sched-out sched-x)) 1)
+(test '(recv sched-out 2000)    1)
+(test 'sched-x                  1)
+(def sched-f (lambda () (list sched-x sched-l)))
+(def sched-l (list 1 2))
+(schedule (lambda () (send sched-out (sched-f))) 1)
+(test '(recv sched-out 2000)    '(1 (1 2)))
+(= sched-x 3)                             ; the next snapshot copies what changed
+(lset sched-l 5 0)
+(schedule (lambda () (send sched-out (sched-f))) 1)
+(test '(recv sched-out 2000)    '(3 (5 2)))
+
+;; profiling returns the value of the profiled expression
+(test '(%profile (lambda () (+ 1 2)) "/tmp/musil_profile_test.folded") 3)
+(test '(info 'typeof profile)    '(macro))
+
+;; per-primitive counters: (op [calls time-us elements elements-per-s] [sizes...])
+(def op-stats (lambda (name l)
+  (if (eq (llength l) 0) ()
+    (if (eq (lindex (lindex l 0) 0) name) (lindex l 0) (op-stats name (ldrop l 1))))))
+(test '(info 'stats 'on)         1)
+(info 'stats 'reset)
+(sin [1 2 3 4])
+(sin [1 2 3 4 5])
+(def sin-stats (op-stats 'sin (info 'stats)))
+(test '(getval (lindex sin-stats 1) 0) 2)     ; calls
+(test '(getval (lindex sin-stats 1) 2) 9)     ; elements
+(test '(lindex sin-stats 2)      [0 0 0 2])   ; both in the 4..7 bucket
+(test '(info 'stats 'off)        0)
+(info 'stats 'reset)
+(sin [1 2 3])
+(test '(op-stats 'sin (info 'stats)) ())
+
+;; memory accounting: atoms reachable from the environment, live atoms while counting
+(def mem-probe (bpf 0 1000 1))
+(test '(>= (dget (info 'memory) 'array-bytes) 8000) 1)
+(test '(> (dget (info 'memory) 'op) 100)       1)
+(test '(>= (dget (info 'memory) 'envs) 1)      1)
+(test '(info 'memory 'on)        1)
+(def mem-live (dget (info 'memory) 'live))
+(def i 0)
+(while (< i 1000) { (list 1 2 3) (= i (+ i 1)) })
+(test '(< (- (dget (info 'memory) 'live) mem-live) 100) 1) ; temporaries are released
+(def mem-dicts (dget (info 'memory) 'live-dict))
+(def mem-kept (list (dict) (dict) (dict)))
+(test '(- (dget (info 'memory) 'live-dict) mem-dicts) 3) ; by type
+(test '(info 'memory 'off)       0)
+(test '(info 'memory 'every 0)   0)
+
+;; in-language benchmarking: stats vector and per-iteration times
+(def bench-r (bench (+ 1 2) 20 2))
+(def bench-s (lindex bench-r 0))
+(test '(size bench-s)                    7)
+(test '(size (lindex bench-r 1))         20)
+(test '(<= (slice bench-s 3 1) (slice bench-s 0 1)) 1) ; min <= median
+(test '(> (slice bench-s 6 1) 0)         1)            ; atoms per run
+
+;; constant folding by load, undone when a folded global is rebound
+(def fold-k 3)
+(def fold-w (* fold-k TWOPI))
+(def fold-f (lambda (x) (* x (+ fold-k 1))))
+(def fold-g (lambda (fold-k) (+ fold-k 1)))       ; parameters shadow globals
+(def fold-h (lambda () { (def fold-k 10) (+ fold-k 1) }))
+(test '(> (slice (info 'folds) 0 1) 0)   1)
+(test 'fold-w                            18.8495559216)
+(test '(fold-f 2)                        8)
+(test '(fold-g 10)                       11)
+(= fold-k 5)
+(test '(fold-f 2)                        12)
+(test '(fold-h)                          11)
+(test 'fold-w                            18.8495559216)
+(def fold-k 7)                                      ; def rebinds through extend too
+(test '(fold-f 2)                        16)
+(def fold-acc 0)                                    ; inlined values changed in place
+(def fold-next (lambda () { (assign fold-acc (+ fold-acc 1) 0 1) (* fold-acc 1) }))
+(test '(list (fold-next) (fold-next) (fold-next)) '(1 2 3))
+(def fold-kk 2)
+(def fold-setk (macro (v) (list 'def 'fold-kk v)))
+(def fold-m (lambda () (begin (fold-setk 10) (* fold-kk 3)))) ; macros may define any name
+(test '(fold-m)                          30)
+(def fold-before (slice (info 'folds) 1 1))
+(function fold-q () (* TWOPI 440))                  ; expanded, then folded as its def
+(test '(> (slice (info 'folds) 1 1) fold-before) 1)
+(test '(fold-q)                          (* TWOPI 440))
+
+;; wall clock and tempo clocks
+(def t-start (now))
+(sleep-until (+ t-start 2e6))
+(test '(>= (- (now) t-start) 2e6)   1)
+(def tc (tempo 120))
+(test '(- (beat->time tc 3) (beat->time tc 2))   5e8)   ; ns per beat
+(test '(time->beat tc (beat->time tc 7))         7)
+(def tc-swing (tempo 120 0.5))
+(test '(- (beat->time tc-swing 1.5) (beat->time tc-swing 1)) 3.75e8)
+(setbpm tc 240)
+(test '(- (beat->time tc 3) (beat->time tc 2))   2.5e8)
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; Booleans & logic
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -629,6 +945,142 @@
 
 (test '(comp square succ 3)      16)      ; square(succ(3)) = 4^2 = 16
 
+;; native list library against its former core.scm definitions
+(function ref-ltake (l n)
+  {
+    (def ref-ltake-runner
+      (lambda (acc l n)
+        (if (<= n 0)
+            acc
+            {
+              (if (eq (car l) '()) acc (lappend acc (car l)))
+              (ref-ltake-runner acc (cdr l) (- n 1))
+            })))
+    (ref-ltake-runner '() l n)
+  })
+
+(function ref-ldrop (l n)
+  (if (<= n 0)
+      l
+      (ref-ldrop (cdr l) (- n 1))))
+
+(function ref-lreverse (l)
+  {
+    (def res '())
+    (def i (- (llength l) 1))
+    (while (>= i 0)
+      {
+        (lappend res (lindex l i))
+        (= i (- i 1))
+      })
+    res
+  })
+
+(function ref-match (e l)
+  {
+    (def ref-match-runner
+      (lambda (acc n e l)
+        (if (eq l '())
+            acc
+            {
+              (if (eq (car l) e) (lappend acc n) acc)
+              (ref-match-runner acc (+ n 1) e (cdr l))
+            })))
+    (ref-match-runner '() 0 e l)
+  })
+
+(function ref-elem (x l)
+  (if (eq (llength (ref-match x l)) 0)
+      false
+      true))
+
+(function ref-zip (l1 l2)
+  (map2 list l1 l2))
+
+(function ref-dup (n x)
+  {
+    (def ref-dup-runner
+      (lambda (acc n x)
+        (if (<= n 0)
+            acc
+            {
+              (lappend acc x)
+              (ref-dup-runner acc (- n 1) x)
+            })))
+    (ref-dup-runner '() n x)
+  })
+
+(function ref-map (f l)
+  {
+    (def ref-map-runner
+      (lambda (acc f l)
+        (if (eq l '())
+            acc
+            {
+              (lappend acc (f (car l)))
+              (ref-map-runner acc f (cdr l))
+            })))
+    (ref-map-runner '() f l)
+  })
+
+(function ref-filter (f l)
+  {
+    (def ref-filter-runner
+      (lambda (acc f l)
+        (if (eq l '())
+            acc
+            {
+              (if (f (car l)) (lappend acc (car l)) acc)
+              (ref-filter-runner acc f (cdr l))
+            })))
+    (ref-filter-runner '() f l)
+  })
+
+(function ref-foldl (f z l)
+  (if (eq l '())
+      z
+      (ref-foldl f (f z (car l)) (cdr l))))
+
+
+(def rl '(3 () 1 [2 2] x "s" 1))
+(test '(map (lambda (x) (* x 2)) '(1 2 3)) (ref-map (lambda (x) (* x 2)) '(1 2 3)))
+(test '(map llength '((1) () (1 2))) (ref-map llength '((1) () (1 2))))
+(test '(filter (lambda (x) (> x 1)) '(3 1 2 0)) (ref-filter (lambda (x) (> x 1)) '(3 1 2 0)))
+(test '(foldl - 10 '(1 2 3))     (ref-foldl - 10 '(1 2 3)))
+(test '(foldl + 0 '())           (ref-foldl + 0 '()))
+(test '(zip rl '(1 2))           (ref-zip rl '(1 2)))
+(test '(lreverse rl)             (ref-lreverse rl))
+(test '(ltake rl 3)              (ref-ltake rl 3))
+(test '(ltake rl 10)             (ref-ltake rl 10))
+(test '(ltake rl 1.5)            (ref-ltake rl 1.5))
+(test '(ldrop rl 2)              (ref-ldrop rl 2))
+(test '(ldrop rl 0)              (ref-ldrop rl 0))
+(test '(ldrop rl 10)             (ref-ldrop rl 10))
+(test '(match 1 rl)              (ref-match 1 rl))
+(test '(match "s" rl)            (ref-match "s" rl))
+(test '(elem 'x rl)              (ref-elem 'x rl))
+(test '(elem 'y rl)              (ref-elem 'y rl))
+(test '(dup 3 rl)                (ref-dup 3 rl))
+(test '(dup 0 1)                 (ref-dup 0 1))
+
+;; parallel map keeps the list order and reads the caller's bindings
+(def pool (threads))
+(threads 4 1000)
+(def offset 100)
+(test '(pmap (lambda (x) (* x x)) '(1 2 3 4 5)) '(1 4 9 16 25))
+(test '(pmap (lambda (x) (+ x offset)) '(1 2 3)) '(101 102 103))
+(test '(pmap abs '(-1 2 -3))      '(1 2 3))
+(test '(pmap (lambda (x) (pmap (lambda (y) (* x y)) '(1 2))) '(1 2))
+      '((1 2) (2 4)))
+(test '(pmap (lambda (x) { (def y (* x 2)) (= y (+ y 1)) y }) '(1 2))
+      '(3 5))
+(test '(pfor-each (lambda (x) x) '(1 2 3)) '())
+(test '(pmap succ '())            '())
+(def pbufs (list [0 0] [0 0]))                       ; tasks change their own element
+(pfor-each (lambda (b) (assign b 1 0 1)) pbufs)
+(test 'pbufs                      (list [1 0] [1 0]))
+(threads (getval pool 0) (getval pool 1))
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; Arithmetic helpers (arrays/scalars)
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -0,0 +1,90 @@
+/* test_fork.c
+ *
+ * Copy-on-write semantics of forked environments (fork_env) and the other
+ * rules for values shared between threads, checked through the C interface
+ * of libmusil, and edge cases of that interface.
+ */
+
+#include "musil_c.h"
+#include <stdio.h>
+#include <string.h>
+
+static int total = 0, failed = 0;
+
+static void test (musil_env* e, const char* code, const char* expected) {
+	++total;
+	if (musil_eval (e, code) != 0) {
+		++failed;
+		printf ("FAIL: %s => error %s\n", code, musil_error (e));
+	} else if (strcmp (musil_result (e), expected) != 0) {
+		++failed;
+		printf ("FAIL: %s => %s, expected %s\n", code, musil_result (e), expected);
+	} else printf ("PASS: %s\n", code);
+}
+static void test_error (musil_env* e, const char* code) {
+	++total;
+	if (musil_eval (e, code) == 0) {
+		++failed;
+		printf ("FAIL: %s => %s, expected an error\n", code, musil_result (e));
+	} else printf ("PASS: %s (error)\n", code);
+}
+
+int main (void) {
+	musil_env* base = musil_create ();
+	if (!base || musil_eval (base, "(def x 1) (def l (list 1 2)) (def n 0) "
+		"(def bump (lambda () (= n (+ n 1))))") != 0) return 1;
+	musil_env* a = musil_fork (base);
+	musil_env* b = musil_fork (base);
+
+	test (a, "(= x 2) x", "2");               /* = copies the binding into the fork */
+	test (b, "x", "1");                       /* base and other forks keep it */
+	test (a, "(def l 5) l", "5");             /* def shadows */
+	test (b, "(llength l)", "2");
+	test (b, "(def m (list 1 2)) (lset m 9 0) (lindex m 0)", "9"); /* own values are mutable */
+
+	test_error (base, "(def y 1)");           /* base is frozen */
+	test_error (b, "(lset l 9 0)");           /* and so are its values */
+	test (b, "(bump) (bump)", "2");           /* closures of base copy into the fork */
+	test (b, "n", "2");
+	test (a, "(list n (bump))", "(0 1)");
+	test (base, "n", "0");
+	test_error (b, "(pmap (lambda (i) (bump)) (list 1 2))"); /* not from parallel tasks */
+
+	musil_env* c = musil_fork (a);            /* fork of a fork */
+	test (c, "(list x l)", "(2 5)");
+	test (c, "(= x 3) (def l 6) (list x l)", "(3 6)");
+	test (a, "(list x l)", "(2 5)");
+	test (b, "(list x (llength l))", "(1 2)");
+	test_error (a, "(= x 4)");                /* a is frozen by its fork */
+
+	test (b, "(def ch (channel)) (def sent [1 2]) (send ch sent) (recv ch)", "[1 2]");
+	test_error (b, "(assign sent 9 0 1)");    /* arrays sent to other threads are frozen */
+	test (b, "(assign (+ sent 0) 9 0 1)", "[9 2]");
+
+	test (b, "(def shared (list)) (def mine (list (list) (list))) "
+		"(pfor-each (lambda (x) (lappend x 1)) mine) mine", "((1) (1))");
+	test_error (b, "(pfor-each (lambda (x) (lappend shared x)) (list 1 2 3))"); /* values shared by tasks */
+	test (b, "shared", "()");
+
+	++total; /* (exit) ends the code, not the host */
+	if (musil_eval (b, "(def before 1) (exit) (def after 1)") != 1) {
+		++failed;
+		printf ("FAIL: (exit) => %s\n", musil_error (b));
+	} else printf ("PASS: (exit)\n");
+	test (b, "(info 'exists 'before 'after)", "(1 0)");
+
+	const double* data = NULL;
+	size_t size = 1;
+	++total; /* empty arrays are not failures */
+	if (!musil_new_array (b, "empty", 0) || musil_get_array (b, "empty", &data, &size) != 0 || size != 0) {
+		++failed;
+		printf ("FAIL: empty array => %s\n", musil_error (b));
+	} else printf ("PASS: empty array\n");
+
+	musil_destroy (c);
+	musil_destroy (b);
+	musil_destroy (a);
+	musil_destroy (base);
+	printf ("Total tests: %d, failed: %d\n", total, failed);
+	return failed ? 1 : 0;
+}